@@ -0,0 +1,44 @@
+db_name=$1
+echo "db_name: $db_name"
+# 定义测试参数数组
+policies=(clock lru 2q arc)
+hist_percents=(0 20 50 80)
+cache_sizes=(4 16 64)  # MB
+compressed_sizes=(0 16)  # MB, 0 disables the compressed tier
+num_account=1000000
+update_count=50
+scan_len=16
+key_size=64
+value_size=256
+
+data_path="$PWD/../data/"
+index_path="$PWD/../index"
+result_dir="$PWD/results_${db_name}/cache_benchmark"
+echo "data_path: $data_path"
+echo "index_path: $index_path"
+echo "result_dir: $result_dir"
+
+mkdir -p $data_path
+mkdir -p $index_path
+mkdir -p ${result_dir}
+
+# 运行测试
+for cache_mb in "${cache_sizes[@]}"; do
+    for compressed_mb in "${compressed_sizes[@]}"; do
+        for hist in "${hist_percents[@]}"; do
+            for policy in "${policies[@]}"; do
+                set -x
+                # 清理数据文件夹
+                rm -rf $data_path/*
+                rm -rf $index_path/*
+
+                result_path="${result_dir}/${policy}c${cache_mb}z${compressed_mb}h${hist}s${scan_len}.csv"
+                echo $(date "+%Y-%m-%d %H:%M:%S")
+                echo "policy: ${policy}, cache: ${cache_mb}MB, compressed: ${compressed_mb}MB, historical: ${hist}%, scan_len: ${scan_len}"
+                ../build_release/bin/cacheBenchmark -a $num_account -t $update_count -p $policy -c $cache_mb -z $compressed_mb -h $hist -s $scan_len -k $key_size -v $value_size -d $data_path -i $index_path -r $result_path
+                sleep 5
+                set +x
+            done
+        done
+    done
+done
@@ -2,4 +2,4 @@
 # ./build.sh
 # cd gowrapper
 # gcc -o test_letus_lib.o test_letus_lib.c /home/xinyu.chen/LETUS_prototype/build_release/libletus.a -lstdc++ -lssl -lcrypto
-gcc -o test_letus_lib.o test_letus_lib.c ../build_release/libletus.a -lstdc++ -lssl -lcrypto
\ No newline at end of file
+gcc -o test_letus_lib.o test_letus_lib.c ../build_release/libletus.a -lstdc++ -lssl -lcrypto -lpthread
\ No newline at end of file
@@ -2,6 +2,13 @@ package letus
 
 import "strconv"
 import "fmt"
+import "unsafe"
+
+/*
+#include "Letus.h"
+#include <stdlib.h>
+*/
+import "C"
 
 func keyInc(s []byte) []byte{
 	// increase string by 1
@@ -50,8 +57,18 @@ type LetusLedgerIterator struct {
 	current_key []byte
 	begin_key []byte
 	end_key []byte
+	// values of the keys window_start, window_start+1, ... read with one
+	// MultiGet, so a scan does not pay a trie descent per key
+	window_start uint64
+	window_values [][]byte
 }
 
+// number of keys read ahead by Value, doubled per window up to the maximum
+const (
+	minValueWindow = 16
+	maxValueWindow = 1024
+)
+
 func NewLetusIterator(db *LetusKVStroage, begin []byte, end []byte) Iterator{
 	it := &LetusIterator{
 		lg: NewLetusLedgerIterator(db, begin, end),
@@ -102,12 +119,39 @@ func (lg *LetusLedgerIterator) Key() interface{} {
 }
 
 func (lg *LetusLedgerIterator) Value() []byte{
-	val, err := lg.db.Get(lg.current_key)
+	current, err := strconv.ParseUint(string(lg.current_key), 10, 64)
 	if err != nil {
 		fmt.Println("Value: ", err)
 		return nil
 	}
-	return val 
+	if current >= lg.window_start && current-lg.window_start < uint64(len(lg.window_values)) {
+		return lg.window_values[current-lg.window_start]
+	}
+	last, err := strconv.ParseUint(string(lg.end_key), 10, 64)
+	if err != nil || last < current {
+		last = current
+	}
+	size := uint64(2 * len(lg.window_values))
+	if size < minValueWindow {
+		size = minValueWindow
+	} else if size > maxValueWindow {
+		size = maxValueWindow
+	}
+	if last-current >= size {
+		last = current + size - 1
+	}
+	keys := make([][]byte, 0, last-current+1)
+	for k := current; k <= last; k++ {
+		keys = append(keys, []byte(strconv.FormatUint(k, 10)))
+	}
+	values, err := lg.db.MultiGet(keys)
+	if err != nil {
+		fmt.Println("Value: ", err)
+		return nil
+	}
+	lg.window_start = current
+	lg.window_values = values
+	return values[0]
 }
 
 func (lg *LetusLedgerIterator) Release() {}
@@ -124,3 +168,72 @@ func (lg *LetusLedgerIterator) Seek(key interface{}) bool{
 }
 
 
+
+// LetusTrieIterator walks the keys as they are stored in the trie, in order.
+// The store keeps sha1hash(key), so begin, end and Key are hashed keys.
+type LetusTrieIterator struct {
+	c *C.LetusIterator
+}
+
+// NewTrieIterator iterates over the stored keys in [begin, end) at the
+// version Get reads, an empty end means no upper bound. Call Release when
+// done.
+func (s *LetusKVStroage) NewTrieIterator(begin, end []byte) *LetusTrieIterator {
+	seq := s.stable_seq_no
+	if seq == 0 {
+		seq = 1
+	}
+	beginC := C.CString(string(begin))
+	defer C.free(unsafe.Pointer(beginC))
+	endC := C.CString(string(end))
+	defer C.free(unsafe.Pointer(endC))
+	return &LetusTrieIterator{
+		c: C.LetusNewIterator(s.c, C.uint64_t(s.tid), C.uint64_t(seq), beginC, endC),
+	}
+}
+
+func (it *LetusTrieIterator) Valid() bool {
+	return bool(C.LetusIteratorValid(it.c))
+}
+
+func (it *LetusTrieIterator) Seek(key []byte) {
+	keyC := C.CString(string(key))
+	defer C.free(unsafe.Pointer(keyC))
+	C.LetusIteratorSeek(it.c, keyC)
+}
+
+func (it *LetusTrieIterator) SeekToFirst() {
+	C.LetusIteratorSeekToFirst(it.c)
+}
+
+func (it *LetusTrieIterator) SeekToLast() {
+	C.LetusIteratorSeekToLast(it.c)
+}
+
+func (it *LetusTrieIterator) Next() {
+	C.LetusIteratorNext(it.c)
+}
+
+func (it *LetusTrieIterator) Prev() {
+	C.LetusIteratorPrev(it.c)
+}
+
+// takes a string returned by the C API and releases it
+func takeCString(str *C.char) []byte {
+	data := []byte(C.GoString(str))
+	C.LetusFreeValues(&str, 1)
+	return data
+}
+
+func (it *LetusTrieIterator) Key() []byte {
+	return takeCString(C.LetusIteratorKey(it.c))
+}
+
+func (it *LetusTrieIterator) Value() []byte {
+	return takeCString(C.LetusIteratorValue(it.c))
+}
+
+func (it *LetusTrieIterator) Release() {
+	C.LetusDeleteIterator(it.c)
+	it.c = nil
+}
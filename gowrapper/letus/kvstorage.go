@@ -9,7 +9,7 @@ import (
 )
 /*
 #cgo CFLAGS: -I${SRCDIR}/../../lib
-#cgo LDFLAGS: -L${SRCDIR}/../../build_release_letus -lletus -lssl -lcrypto -lstdc++
+#cgo LDFLAGS: -L${SRCDIR}/../../build_release_letus -lletus -lssl -lcrypto -lstdc++ -lpthread
 #include "Letus.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,6 +24,16 @@ func sha1hash(key []byte) []byte {
 	return keyhashstr
 }
 
+// digests are binary and may contain zero bytes, copy LetusGetHashSize bytes
+func digestBytes(hash *C.char) []byte {
+	return C.GoBytes(unsafe.Pointer(hash), C.int(C.LetusGetHashSize()))
+}
+
+// HashAlgorithm returns the name of the hash the library was built with.
+func HashAlgorithm() string {
+	return C.GoString(C.LetusGetHashAlgorithm())
+}
+
 func getCPtr(data []byte) *C.char {
 	return (*C.char)(unsafe.Pointer(&[]byte(string(data))[0]))
 }
@@ -55,22 +65,63 @@ func (s *LetusKVStroage) Put(key []byte, value []byte) error {
 }
 
 func (s *LetusKVStroage) Get(key []byte) ([]byte, error) {
-	var value *C.char
 	sha1key := sha1hash(key)
-
-	if s.stable_seq_no != 0 {
-		value = C.LetusGet(s.c, C.uint64_t(s.tid), C.uint64_t(s.stable_seq_no), getCPtr(sha1key))
-		fmt.Printf("Letus Get! tid=%d, seq=%d, key=%s(%s), value=%s\n", s.tid, s.stable_seq_no, string(key), string(sha1key), C.GoString(value))
-	} else  {
-		value = C.LetusGet(s.c, C.uint64_t(s.tid), C.uint64_t(1), getCPtr(sha1key))
-		fmt.Printf("Letus Get! tid=%d, seq=%d, key=%s(%s), value=%s\n", s.tid, 1, string(key), string(sha1key), C.GoString(value))
-	} 
-		
-	if value == nil || C.GoString(value) == "" {
+	seq := s.stable_seq_no
+	if seq == 0 {
+		seq = 1
+	}
+	// the view points into the value log, GoBytes is the only copy
+	var size C.uint64_t
+	view := C.LetusGetView(s.c, C.uint64_t(s.tid), C.uint64_t(seq), getCPtr(sha1key), &size)
+	if view == nil && size == 0 {
+		return nil, fmt.Errorf("get of version %d failed", seq)
+	}
+	if size == 0 {
+		fmt.Printf("Letus Get! tid=%d, seq=%d, key=%s(%s), value=\n", s.tid, seq, string(key), string(sha1key))
 		return nil, fmt.Errorf("key not found")
 	}
-	return []byte(C.GoString(value)), nil
+	value := C.GoBytes(unsafe.Pointer(view), C.int(size))
+	fmt.Printf("Letus Get! tid=%d, seq=%d, key=%s(%s), value=%s\n", s.tid, seq, string(key), string(sha1key), string(value))
+	return value, nil
+}
+
+// MultiGet reads many keys at the same version as Get in one call. The
+// result has one entry per key, nil when the key is not found.
+func (s *LetusKVStroage) MultiGet(keys [][]byte) ([][]byte, error) {
+	count := len(keys)
+	if count == 0 {
+		return nil, nil
 	}
+	seq := s.stable_seq_no
+	if seq == 0 {
+		seq = 1
+	}
+	ptrSize := C.size_t(unsafe.Sizeof(uintptr(0)))
+	keysC := (**C.char)(C.malloc(C.size_t(count) * ptrSize))
+	defer C.free(unsafe.Pointer(keysC))
+	valuesC := (**C.char)(C.malloc(C.size_t(count) * ptrSize))
+	defer C.free(unsafe.Pointer(valuesC))
+	keySlice := unsafe.Slice(keysC, count)
+	for i, key := range keys {
+		keySlice[i] = C.CString(string(sha1hash(key)))
+	}
+	ok := bool(C.LetusMultiGet(s.c, C.uint64_t(s.tid), C.uint64_t(seq), keysC, C.uint64_t(count), valuesC))
+	if !ok {
+		for i := range keys {
+			C.free(unsafe.Pointer(keySlice[i]))
+		}
+		return nil, fmt.Errorf("multiget of version %d failed", seq)
+	}
+	values := make([][]byte, count)
+	for i, value := range unsafe.Slice(valuesC, count) {
+		if value != nil && *value != 0 {
+			values[i] = []byte(C.GoString(value))
+		}
+		C.free(unsafe.Pointer(keySlice[i]))
+	}
+	C.LetusFreeValues(valuesC, C.uint64_t(count))
+	return values, nil
+}
 	
 func (s *LetusKVStroage) Delete(key []byte) error {
 	sha1key := sha1hash(key)
@@ -91,14 +142,30 @@ func (s* LetusKVStroage) Revert(seq_ uint64) error {
 func (s* LetusKVStroage) CalcRootHash(seq_ uint64) error { 
 	seq := seq_ + 1
 	fmt.Println("Letus calculate root hash! version=", seq)
-	C.LetusCalcRootHash(s.c, C.uint64_t(s.tid), C.uint64_t(seq))
+	if !bool(C.LetusCalcRootHash(s.c, C.uint64_t(s.tid), C.uint64_t(seq))) {
+		return fmt.Errorf("commit of version %d failed", seq)
+	}
+	return nil 
+}
+
+// CalcRootHashAsync starts hashing version seq_+1 in the background and
+// returns at once, so the next block can be put while it runs. Reads of the
+// version wait until it is published.
+func (s* LetusKVStroage) CalcRootHashAsync(seq_ uint64) error { 
+	seq := seq_ + 1
+	fmt.Println("Letus calculate root hash async! version=", seq)
+	if !bool(C.LetusCommitAsync(s.c, C.uint64_t(s.tid), C.uint64_t(seq))) {
+		return fmt.Errorf("commit before version %d failed", seq)
+	}
 	return nil 
 }
 
 func (s* LetusKVStroage) Write(seq_ uint64) error { 
 	seq := seq_ + 1
 	fmt.Println("Letus flush! version=", seq)
-	C.LetusFlush(s.c, C.uint64_t(s.tid), C.uint64_t(seq))
+	if !bool(C.LetusFlush(s.c, C.uint64_t(s.tid), C.uint64_t(seq))) {
+		return fmt.Errorf("flush of version %d failed", seq)
+	}
 	s.stable_seq_no = seq
 	s.current_seq_no = seq + 1
 	return nil 
@@ -107,7 +174,9 @@ func (s* LetusKVStroage) Write(seq_ uint64) error {
 func (s* LetusKVStroage) Commit(seq_ uint64) error { 
 	seq := seq_ + 1
 	fmt.Println("Letus commit! version=", seq)
-	C.LetusFlush(s.c, C.uint64_t(s.tid), C.uint64_t(seq))
+	if !bool(C.LetusFlush(s.c, C.uint64_t(s.tid), C.uint64_t(seq))) {
+		return fmt.Errorf("flush of version %d failed", seq)
+	}
 	return nil 
 }
 
@@ -140,20 +209,23 @@ func (s *LetusKVStroage) Proof(key []byte, seq_ uint64) (types.ProofPath, error)
 	seq := seq_ + 1
 	sha1key := sha1hash(key)
 	proof_path_c := C.LetusProof(s.c, C.uint64_t(s.tid), C.uint64_t(seq), getCPtr(sha1key))
+	if proof_path_c == nil {
+		return nil, fmt.Errorf("proof of version %d failed", seq)
+	}
 	proof_path_size := C.LetusGetProofPathSize(proof_path_c)
 	proof_path := make(types.ProofPath, proof_path_size)
 	for i:=0; i < int(proof_path_size); i++ {
 		proof_node_size := C.LetusGetProofNodeSize(proof_path_c, C.uint64_t(i))
 		proof_path[i] = &types.ProofNode{
 			IsData: bool(C.LetusGetProofNodeIsData(proof_path_c, C.uint64_t(i))),
-			Hash: []byte(C.GoString(C.LetusGetProofNodeHash(proof_path_c, C.uint64_t(i)))),
+			Hash: digestBytes(C.LetusGetProofNodeHash(proof_path_c, C.uint64_t(i))),
 			Key: []byte(C.GoString(C.LetusGetProofNodeKey(proof_path_c, C.uint64_t(i)))),
 			Index: int(C.LetusGetProofNodeIndex(proof_path_c, C.uint64_t(i))),
 			Inodes: make(types.Inodes, proof_node_size),
 		}
 		for j:=0; j < int(proof_node_size); j++ {
 			proof_path[i].Inodes[j] = &types.Inode{
-				Hash: []byte(C.GoString(C.LetusGetINodeHash(proof_path_c, C.uint64_t(i), C.uint64_t(j)))),
+				Hash: digestBytes(C.LetusGetINodeHash(proof_path_c, C.uint64_t(i), C.uint64_t(j))),
 				Key: []byte(C.GoString(C.LetusGetINodeKey(proof_path_c, C.uint64_t(i), C.uint64_t(j)))),
 			}
 		}
@@ -161,6 +233,39 @@ func (s *LetusKVStroage) Proof(key []byte, seq_ uint64) (types.ProofPath, error)
 	return proof_path, nil
 }
 
+// MultiProof proves many keys at seq with one proof in which the nodes shared
+// by their paths appear once. The proof is in the serialized form of the
+// library and holds the stored (hashed) keys with their values.
+func (s *LetusKVStroage) MultiProof(keys [][]byte, seq_ uint64) ([]byte, error) {
+	seq := seq_ + 1
+	count := len(keys)
+	ptrSize := C.size_t(unsafe.Sizeof(uintptr(0)))
+	keysC := (**C.char)(C.malloc(C.size_t(count+1) * ptrSize))
+	defer C.free(unsafe.Pointer(keysC))
+	keySlice := unsafe.Slice(keysC, count+1)
+	for i, key := range keys {
+		keySlice[i] = C.CString(string(sha1hash(key)))
+		defer C.free(unsafe.Pointer(keySlice[i]))
+	}
+	var size C.uint64_t
+	proof_c := C.LetusMultiProof(s.c, C.uint64_t(s.tid), C.uint64_t(seq), keysC, C.uint64_t(count), &size)
+	if proof_c == nil {
+		return nil, fmt.Errorf("multiproof of version %d failed", seq)
+	}
+	defer C.LetusFreeBuffer(proof_c)
+	return C.GoBytes(unsafe.Pointer(proof_c), C.int(size)), nil
+}
+
+// VerifyMultiProof checks a proof returned by MultiProof against a root hash.
+func (s *LetusKVStroage) VerifyMultiProof(rootHash []byte, proof []byte) bool {
+	if len(rootHash) != int(C.LetusGetHashSize()) || len(proof) == 0 {
+		return false
+	}
+	return bool(C.LetusVerifyMultiProof(s.c, C.uint64_t(s.tid),
+		(*C.char)(unsafe.Pointer(&rootHash[0])),
+		(*C.char)(unsafe.Pointer(&proof[0])), C.uint64_t(len(proof))))
+}
+
 // func (s *LetusKVStroage) SetEngine(engine cryptocom.Engine) {}
 func (s *LetusKVStroage) FSync(seq uint64) error { return nil }
 
@@ -0,0 +1,12 @@
+#ifndef _BLAKE3_HPP_
+#define _BLAKE3_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+static constexpr size_t BLAKE3_OUT_LEN = 32;
+
+// portable BLAKE3 in hash mode with the default 32-byte output
+void Blake3Hash(const char *data, size_t size, unsigned char *out);
+
+#endif
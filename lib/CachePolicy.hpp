@@ -0,0 +1,173 @@
+#ifndef _CACHEPOLICY_HPP_
+#define _CACHEPOLICY_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "NibblePath.hpp"
+
+using namespace std;
+
+class BasePage;
+
+// a page held by a PageCache shard. The links belong to the replacement
+// policy of the shard, which keeps the entry in one of its queues
+struct CacheEntry {
+  PackedPageKey key;
+  BasePage *page;
+  size_t bytes;  // measured when cached or changed
+  CacheEntry *prev = nullptr;
+  CacheEntry *next = nullptr;
+  uint8_t queue = 0;  // numbered by the policy
+};
+
+// intrusive list of entries, most recently added first
+class EntryQueue {
+ public:
+  bool Empty() const { return head_ == nullptr; }
+  size_t Bytes() const { return bytes_; }
+  CacheEntry *Back() const { return tail_; }
+  void PushFront(CacheEntry *entry);
+  void Remove(CacheEntry *entry);
+  void Resize(size_t old_bytes, size_t new_bytes) {
+    bytes_ += new_bytes - old_bytes;
+  }
+
+ private:
+  CacheEntry *head_ = nullptr;
+  CacheEntry *tail_ = nullptr;
+  size_t bytes_ = 0;
+};
+
+// keys of evicted pages with their sizes, oldest dropped first
+class GhostQueue {
+ public:
+  void Push(const PackedPageKey &key, size_t bytes);
+  bool Erase(const PackedPageKey &key);  // false if key is not remembered
+  void PopBack();
+  bool Empty() const { return keys_.empty(); }
+  size_t Bytes() const { return bytes_; }
+
+ private:
+  using KeyList = list<pair<PackedPageKey, size_t>>;
+  KeyList keys_;  // newest first
+  unordered_map<PackedPageKey, KeyList::iterator, PackedPageKey::Hash>
+      index_;
+  size_t bytes_ = 0;
+};
+
+// decides which page of a shard is evicted next. A shard owns one policy
+// and calls it under the shard lock, the policy only orders the entries, it
+// never frees or retires a page
+class CachePolicy {
+ public:
+  virtual ~CachePolicy() = default;
+
+  // entry was just cached. An entry keeps its place when the cache rekeys
+  // it after a commit
+  virtual void Insert(CacheEntry *entry) = 0;
+  virtual void Access(CacheEntry *entry) = 0;  // a hit
+  // entry leaves the cache other than by eviction
+  virtual void Remove(CacheEntry *entry) = 0;
+  // the page of entry was measured again, entry->bytes holds the new size
+  virtual void Resize(CacheEntry *entry, size_t old_bytes) = 0;
+  // unlinks and returns the entry to evict, nullptr when nothing is cached
+  virtual CacheEntry *Evict() = 0;
+};
+
+// kCLOCK approximates LRU with a reference bit per page, a hit only sets the
+// bit. kLRU evicts the least recently used page. k2Q keeps pages seen once
+// in a FIFO of a quarter of the budget and only moves pages seen again after
+// leaving it into the main LRU, so a scan of historical pages cycles through
+// the FIFO without evicting the hot upper-level pages. kARC also tells pages
+// seen once from pages seen again, but tunes the share of both from the
+// misses on recently evicted keys
+enum class CachePolicyType { kCLOCK, kLRU, k2Q, kARC };
+
+const char *CachePolicyName(CachePolicyType type);
+// capacity is the byte budget of the shard using the policy
+unique_ptr<CachePolicy> NewCachePolicy(CachePolicyType type,
+                                       size_t capacity);
+
+// builds the policy of each shard from its byte budget, for policies other
+// than the built-in ones
+using CachePolicyFactory = function<unique_ptr<CachePolicy>(size_t)>;
+
+// the entries form a ring the hand walks around. Pages it passes with the
+// reference bit set lose the bit, the first page without it is evicted
+class ClockPolicy : public CachePolicy {
+ public:
+  void Insert(CacheEntry *entry) override;
+  void Access(CacheEntry *entry) override;
+  void Remove(CacheEntry *entry) override;
+  void Resize(CacheEntry *entry, size_t old_bytes) override;
+  CacheEntry *Evict() override;
+
+ private:
+  CacheEntry *hand_ = nullptr;  // next page to look at
+};
+
+class LRUPolicy : public CachePolicy {
+ public:
+  void Insert(CacheEntry *entry) override;
+  void Access(CacheEntry *entry) override;
+  void Remove(CacheEntry *entry) override;
+  void Resize(CacheEntry *entry, size_t old_bytes) override;
+  CacheEntry *Evict() override;
+
+ private:
+  EntryQueue pages_;  // most recently used first
+};
+
+// 2Q by Johnson and Shasha, with the queue sizes in bytes
+class TwoQueuePolicy : public CachePolicy {
+ public:
+  explicit TwoQueuePolicy(size_t capacity);
+
+  void Insert(CacheEntry *entry) override;
+  void Access(CacheEntry *entry) override;
+  void Remove(CacheEntry *entry) override;
+  void Resize(CacheEntry *entry, size_t old_bytes) override;
+  CacheEntry *Evict() override;
+
+ private:
+  enum Queue : uint8_t { kIn = 0, kMain = 1 };
+
+  EntryQueue &QueueOf(CacheEntry *entry);
+
+  size_t in_bytes_;   // budget of in_
+  size_t out_bytes_;  // budget of out_, in bytes of the evicted pages
+  EntryQueue in_;     // pages seen once, first in first out
+  EntryQueue main_;   // pages seen again, most recently used first
+  GhostQueue out_;    // keys evicted from in_
+};
+
+// ARC by Megiddo and Modha, with the target size and the queues in bytes
+class ARCPolicy : public CachePolicy {
+ public:
+  explicit ARCPolicy(size_t capacity);
+
+  void Insert(CacheEntry *entry) override;
+  void Access(CacheEntry *entry) override;
+  void Remove(CacheEntry *entry) override;
+  void Resize(CacheEntry *entry, size_t old_bytes) override;
+  CacheEntry *Evict() override;
+
+ private:
+  enum Queue : uint8_t { kRecent = 0, kFrequent = 1 };
+
+  EntryQueue &QueueOf(CacheEntry *entry);
+  void TrimGhosts();
+
+  size_t capacity_;
+  size_t target_;        // bytes of recent_ aimed at
+  EntryQueue recent_;    // T1, pages seen once
+  EntryQueue frequent_;  // T2, pages seen at least twice
+  GhostQueue recent_ghosts_;    // B1, keys evicted from recent_
+  GhostQueue frequent_ghosts_;  // B2, keys evicted from frequent_
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef _COMPRESSEDCACHE_HPP_
+#define _COMPRESSEDCACHE_HPP_
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "NibblePath.hpp"
+
+using namespace std;
+
+class BasePage;
+
+// LZ4 block format. LZ4Compress writes at most LZ4CompressBound(size)
+// bytes; LZ4Decompress returns the size of the output, or -1 when src is
+// malformed or does not fit into capacity bytes
+size_t LZ4CompressBound(size_t size);
+size_t LZ4Compress(const char *src, size_t size, char *dst);
+int64_t LZ4Decompress(const char *src, size_t size, char *dst,
+                      size_t capacity);
+
+// second tier of the basepage cache. Pages evicted from the PageCache are
+// kept in their serialized form, LZ4 compressed, under a budget of their
+// own, so reading one again costs a decompress instead of a LoadPage. A
+// serialized page is a fraction of the PAGE_SIZE buffer and node objects of
+// a cached one, so the tier holds several times more pages per byte. A page
+// leaves the tier when it is read, as it goes back to the PageCache, and the
+// oldest pages are dropped first when the tier is over its budget.
+class CompressedCache {
+ public:
+  explicit CompressedCache(size_t max_bytes);
+
+  void Put(const PackedPageKey &key, BasePage *page);  // page is not kept
+  // the serialized page of key, which is removed from the tier. false on a
+  // miss
+  bool Take(const PackedPageKey &key, string &buffer);
+  void Erase(const PackedPageKey &key);  // the page of key changed
+
+  size_t Size() const;         // number of pages
+  size_t MemoryUsage() const;  // bytes of the compressed pages
+  size_t RawBytes() const;     // bytes of the same pages serialized
+  size_t MaxBytes() const;
+  uint64_t Hits() const;
+  uint64_t Misses() const;
+
+ private:
+  struct Blob {
+    PackedPageKey key;
+    string data;  // compressed
+    size_t raw_size;
+  };
+  using BlobList = list<Blob>;
+
+  static size_t BytesOf(const Blob &blob);
+  void Remove(BlobList::iterator it);  // requires mutex_
+
+  size_t max_bytes_;
+  mutable mutex mutex_;
+  BlobList blobs_;  // newest first
+  unordered_map<PackedPageKey, BlobList::iterator, PackedPageKey::Hash>
+      index_;
+  size_t bytes_;
+  size_t raw_bytes_;
+  uint64_t hits_;
+  uint64_t misses_;
+};
+
+#endif
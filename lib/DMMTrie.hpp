@@ -2,19 +2,31 @@
 #define _DMMTRIE_HPP_
 
 #include <array>
+#include <atomic>
 #include <cstring>
+#include <future>
 #include <iostream>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
 
+#include "CompressedCache.hpp"
+#include "Hash.hpp"
+#include "KeyFilter.hpp"
+#include "LatestIndex.hpp"
+#include "NibblePath.hpp"
+#include "PageCache.hpp"
+#include "ThreadPool.hpp"
 #include "VDLS.hpp"
+#include "WriteBuffer.hpp"
 #include "common.hpp"
 
-static constexpr size_t HASH_SIZE = 32;
 static constexpr size_t DMM_NODE_FANOUT = 16;
 static constexpr uint16_t Td_ = 128;  // update threshold of DeltaPage
 static constexpr uint16_t Tb_ = 256;  // update threshold of BasePage
@@ -23,15 +35,14 @@ using namespace std;
 
 class LSVPS;
 class DMMTrie;
+class DMMTrieIterator;
 class DeltaPage;
 
-string HashFunction(const string &input);
-
 struct NodeProof {
   int level;
   int index;
   uint16_t bitmap;
-  vector<string> sibling_hash;
+  array<Digest, DMM_NODE_FANOUT> sibling_hash;
 };
 
 struct DMMTrieProof {
@@ -39,6 +50,26 @@ struct DMMTrieProof {
   vector<NodeProof> proofs;
 };
 
+// one indexnode of a multi-key proof. Empty children are only marked in the
+// bitmap, the hashes of proven children are derived from the values and the
+// nodes that follow, so only the other non-empty children carry a hash
+struct MultiProofNode {
+  uint16_t bitmap;  // non-empty children
+  uint16_t proven;  // children on the path of a proven key
+  vector<Digest> sibling_hash;  // children of bitmap not proven, in order
+};
+
+// proof of many keys at one version: the indexnodes on the paths of the keys
+// in pre-order, a node shared by several paths appears once
+struct DMMTrieMultiProof {
+  vector<string> keys;    // sorted, unique, lower case
+  vector<string> values;  // "" for keys not in the trie
+  vector<MultiProofNode> nodes;
+
+  void SerializeTo(string &buffer) const;
+  bool Deserialize(const char *buffer, size_t size);
+};
+
 class Node {
  public:
   virtual ~Node() = default;
@@ -49,21 +80,23 @@ class Node {
   virtual void DeserializeFrom(char *buffer, size_t &current_size,
                                bool is_root) = 0;
   virtual void AddChild(int index, Node *child, uint64_t version,
-                        const string &hash);
+                        const Digest &hash);
   virtual Node *GetChild(int index) const;
   virtual bool HasChild(int index) const;
-  virtual void SetChild(int index, uint64_t version, string hash);
-  virtual string GetChildHash(int index);
+  virtual void SetChild(int index, uint64_t version, const Digest &hash);
+  virtual Digest GetChildHash(int index);
   virtual uint64_t GetChildVersion(int index);
   virtual void UpdateNode();
   virtual void SetLocation(tuple<uint64_t, uint64_t, uint64_t> location);
 
-  virtual string GetHash() = 0;
+  virtual Digest GetHash() = 0;
   virtual uint64_t GetVersion() = 0;
   virtual void SetVersion(uint64_t version) = 0;
-  virtual void SetHash(string hash) = 0;
+  virtual void SetHash(const Digest &hash) = 0;
 
   virtual bool IsLeaf() const = 0;
+  // bytes of the node and everything it owns
+  virtual size_t MemoryUsage() const = 0;
 
   virtual NodeProof GetNodeProof(int level, int index);
 };
@@ -72,7 +105,7 @@ class LeafNode : public Node {
  public:
   LeafNode(uint64_t V = 0, const string &k = "",
            const tuple<uint64_t, uint64_t, uint64_t> &l = {},
-           const string &h = "");
+           const Digest &h = Digest());
   void CalculateHash(const string &value);
   void SerializeTo(char *buffer, size_t &current_size,
                    bool is_root) const override;
@@ -80,58 +113,65 @@ class LeafNode : public Node {
                        bool is_root) override;
   void UpdateNode(uint64_t version,
                   const tuple<uint64_t, uint64_t, uint64_t> &location,
-                  const string &value, uint8_t location_in_page,
+                  const Digest &value_hash, uint8_t location_in_page,
                   DeltaPage *deltapage);
   tuple<uint64_t, uint64_t, uint64_t> GetLocation() const;
   void SetLocation(tuple<uint64_t, uint64_t, uint64_t> location) override;
-  string GetHash();
+  Digest GetHash();
   uint64_t GetVersion();
   void SetVersion(uint64_t version);
-  void SetHash(string hash);
+  void SetHash(const Digest &hash);
   bool IsLeaf() const override;
+  size_t MemoryUsage() const override;
 
  private:
   uint64_t version_;
   string key_;
   tuple<uint64_t, uint64_t, uint64_t>
       location_;  // location tuple (fileID, offset, size)
-  string hash_;
+  Digest hash_;
   const bool is_leaf_;
 };
 
 class IndexNode : public Node {
  public:
-  IndexNode(uint64_t V = 0, const string &h = "", uint16_t b = 0);
+  IndexNode(uint64_t V = 0, const Digest &h = Digest(), uint16_t b = 0);
   IndexNode(
-      uint64_t version, const string &hash, uint16_t bitmap,
-      const array<tuple<uint64_t, string, Node *>, DMM_NODE_FANOUT> &children);
+      uint64_t version, const Digest &hash, uint16_t bitmap,
+      const array<tuple<uint64_t, Digest, Node *>, DMM_NODE_FANOUT> &children);
   IndexNode(const IndexNode &other);
   void CalculateHash() override;
   void SerializeTo(char *buffer, size_t &current_size,
                    bool is_root) const override;
   void DeserializeFrom(char *buffer, size_t &current_size,
                        bool is_root) override;
-  void UpdateNode(uint64_t version, int index, const string &child_hash,
-                  uint8_t location_in_page, DeltaPage *deltapage);
+  void UpdateNode(uint64_t version, int index, const Digest &child_hash);
+  void MarkChildDirty(uint64_t version, int index);
+  void FinalizeHash(uint8_t location_in_page, DeltaPage *deltapage);
+  size_t ConcatChildHashes(char *buffer) const;
   void AddChild(int index, Node *child, uint64_t version = 0,
-                const string &hash = "") override;
+                const Digest &hash = Digest()) override;
   Node *GetChild(int index) const override;
   bool HasChild(int index) const override;
-  void SetChild(int index, uint64_t version, string hash) override;
-  string GetChildHash(int index);
+  void SetChild(int index, uint64_t version, const Digest &hash) override;
+  Digest GetChildHash(int index);
   uint64_t GetChildVersion(int index);
-  string GetHash();
+  Digest GetHash();
   uint64_t GetVersion();
   void SetVersion(uint64_t version);
-  void SetHash(string hash);
+  void SetHash(const Digest &hash);
   bool IsLeaf() const override;
+  size_t MemoryUsage() const override;
   NodeProof GetNodeProof(int level, int index);
 
  private:
+  void EmitDirtyChildren(uint8_t location_in_page, DeltaPage *deltapage);
+
   uint64_t version_;
-  string hash_;
+  Digest hash_;
   uint16_t bitmap_;  // bitmap for children
-  array<tuple<uint64_t, string, Node *>, DMM_NODE_FANOUT> children_;  // trie
+  uint16_t dirty_;   // children updated since hash_ was last computed
+  array<tuple<uint64_t, Digest, Node *>, DMM_NODE_FANOUT> children_;  // trie
   const bool is_leaf_;
 };
 
@@ -141,7 +181,7 @@ class DeltaPage : public Page {
     uint8_t location_in_page;
     bool is_leaf_node;
     uint64_t version;
-    string hash;
+    Digest hash;
 
     // unique items for leafnode
     uint64_t fileID;
@@ -150,12 +190,12 @@ class DeltaPage : public Page {
 
     // unique items for indexnode
     uint8_t index;
-    string child_hash;
+    Digest child_hash;
 
     DeltaItem() {}
-    DeltaItem(uint8_t loc, bool leaf, uint64_t ver, const string &h,
+    DeltaItem(uint8_t loc, bool leaf, uint64_t ver, const Digest &h,
               uint64_t fID = 0, uint64_t off = 0, uint64_t sz = 0,
-              uint8_t idx = 0, const string &ch_hash = "");
+              uint8_t idx = 0, const Digest &ch_hash = Digest());
     DeltaItem(char *buffer, size_t &current_size);
     void SerializeTo(std::ofstream &out) const;
     void SerializeTo(char *buffer, size_t &current_size) const;
@@ -168,9 +208,9 @@ class DeltaPage : public Page {
   DeltaPage(const DeltaPage &other);
   ~DeltaPage();
   void AddIndexNodeUpdate(uint8_t location, uint64_t version,
-                          const string &hash, uint8_t index,
-                          const string &child_hash);
-  void AddLeafNodeUpdate(uint8_t location, uint64_t version, const string &hash,
+                          const Digest &hash, uint8_t index,
+                          const Digest &child_hash);
+  void AddLeafNodeUpdate(uint8_t location, uint64_t version, const Digest &hash,
                          uint64_t fileID, uint64_t offset, uint64_t size);
   size_t SerializeTo();
   void ClearDeltaPage();
@@ -200,37 +240,130 @@ class BasePage : public Page {
   BasePage(const BasePage &other);  // deep copy
   ~BasePage();
   size_t SerializeTo();
+  // into buffer of PAGE_SIZE bytes instead of the page's own buffer
+  size_t SerializeTo(char *buffer);
   void UpdatePage(uint64_t version,
                   tuple<uint64_t, uint64_t, uint64_t> location,
-                  const string &value, const string &nibbles,
-                  const string &child_hash, DeltaPage *deltapage,
-                  PageKey pagekey);
+                  string_view nibbles, const Digest &hash,
+                  DeltaPage *deltapage, PageKey pagekey);
+  void FinalizePage(uint64_t version, DeltaPage *deltapage, PageKey pagekey);
   void UpdateDeltaItem(const DeltaPage::DeltaItem &deltaitem);
   Node *GetRoot() const;
+  size_t MemoryUsage() const;  // bytes of the page and its nodes
 
  private:
   DMMTrie *trie_;
   Node *root_;  // the root of the page
 };
 
+// The reads (Get, MultiGet, GetHistory, proofs and iterators) of committed
+// versions may run on any number of threads, concurrently with one writer
+// thread doing the puts, deletes and commits. A commit only blocks readers
+// while it updates the cached pages in place.
 class DMMTrie {
  public:
+  // commit_threads > 1 enables the level-by-level parallel commit.
+  // cache_bytes is the memory budget of the cached basepages, cache_policy
+  // picks the basepages evicted when the budget is reached. The newest pages
+  // of the first pinned_levels page levels are never evicted and not charged
+  // to the budget
   DMMTrie(uint64_t tid, LSVPS *page_store, VDLS *value_store,
-          uint64_t current_version = 0);
+          uint64_t current_version = 0, size_t commit_threads = 1,
+          size_t cache_bytes = kDefaultCacheBytes,
+          CachePolicyType cache_policy = CachePolicyType::kCLOCK,
+          size_t pinned_levels = kDefaultPinnedLevels);
   ~DMMTrie();
   bool Put(uint64_t tid, uint64_t version, const string &key,
            const string &value);
   string Get(uint64_t tid, uint64_t version, const string &key);
+  // the value as a view into the mapped value log, valid as long as the
+  // VDLS of the trie. Empty when the key is not found
+  string_view GetView(uint64_t tid, uint64_t version, const string &key);
+  // point reads of many keys at one version. The keys are walked in sorted
+  // order so pages on shared prefixes are loaded once, and the values are
+  // read from VDLS grouped by file and offset. values[i] belongs to keys[i],
+  // "" when the key is not found
+  vector<string> MultiGet(uint64_t tid, uint64_t version,
+                          const vector<string> &keys);
+  // the writes of key with from_version <= version <= to_version, oldest
+  // first; a delete has an empty value. Only the deltapages and basepages of
+  // the leaf page stored by the versions it changed at are read, so the cost
+  // follows the number of changes of the page rather than the number of
+  // versions
+  vector<pair<uint64_t, string>> GetHistory(uint64_t tid, const string &key,
+                                            uint64_t from_version,
+                                            uint64_t to_version);
+  // ordered scan over the keys in [begin, end) at version, an empty end means
+  // no upper bound. The iterator is positioned with Seek/SeekToFirst/
+  // SeekToLast before use
+  unique_ptr<DMMTrieIterator> NewIterator(uint64_t tid, uint64_t version,
+                                          const string &begin,
+                                          const string &end);
   void Delete(uint64_t tid, uint64_t version, const string &key);
+  // batched Put/Delete, the version is checked once per batch. The vector
+  // overloads take ownership of the strings; the pointer overloads borrow the
+  // caller's memory, which must stay valid until the commit of this version
+  // is finished
+  bool PutBatch(uint64_t tid, uint64_t version,
+                vector<pair<string, string>> &&kvs);
+  bool PutBatch(uint64_t tid, uint64_t version, const KeyValueRef *kvs,
+                size_t count);
+  bool DeleteBatch(uint64_t tid, uint64_t version, vector<string> &&keys);
+  bool DeleteBatch(uint64_t tid, uint64_t version, const string_view *keys,
+                   size_t count);
   void Commit(uint64_t version);
   void CalcRootHash(uint64_t tid, uint64_t version);
+  // pipelined commit: takes the buffered writes of version and commits them
+  // on a background thread, the future holds the root hash. Puts of the next
+  // version are accepted meanwhile; reads, Flush and the next commit wait
+  // until this version is published
+  shared_future<string> CommitAsync(uint64_t tid, uint64_t version);
+  // waits for the pending CommitAsync, throws its error if it failed
+  void WaitForCommit();
+  // keeps a flat key -> location index of the newest committed version, so
+  // Get/MultiGet at that version skip the trie. max_bytes bounds the index,
+  // 0 means unbounded
+  void EnableLatestIndex(size_t max_bytes = 0);
+  const LatestIndex *GetLatestIndex() const;  // nullptr when disabled
+  // keeps a Bloom filter of the written keys, so Get/MultiGet/GetProof of a
+  // key that was never written return "not found" without loading pages.
+  // fp_rate is the target false-positive rate, expected_keys the initial
+  // capacity. The filter saved by Flush is reused when it was saved at the
+  // newest committed version, otherwise it is built from the keys of that
+  // version. It answers for that version and later ones, older versions are
+  // read through the trie
+  void EnableKeyFilter(double fp_rate = 0.01, size_t expected_keys = 1 << 20);
+  const KeyFilter *GetKeyFilter() const;  // nullptr when disabled
+  // keeps the basepages evicted from the cache LZ4 compressed in max_bytes
+  // of memory, so reading them again skips LSVPS
+  void EnableCompressedCache(size_t max_bytes);
+  const CompressedCache *GetCompressedCache() const;  // nullptr when disabled
+  size_t GetCacheMemoryUsage() const;  // bytes of the cached basepages
+  size_t GetCacheBudget() const;
+  // lookups of basepages that found or missed them in the cache
+  uint64_t GetCacheHits() const;
+  uint64_t GetCacheMisses() const;
+  size_t GetPinnedMemoryUsage() const;  // bytes of the pinned basepages
+  size_t GetPinnedPageCount() const;
   string GetRootHash(uint64_t tid, uint64_t version);
   DMMTrieProof GetProof(uint64_t tid, uint64_t version, const string &key);
   bool Verify(uint64_t tid, const string &key, const string &value,
               string root_hash, DMMTrieProof proof);
   bool Verify(uint64_t tid, uint64_t version, string root_hash);
+  // proves all keys with one deduplicated proof. Keys that are not
+  // hexadecimal cannot be in the trie and are left out
+  DMMTrieMultiProof GetMultiProof(uint64_t tid, uint64_t version,
+                                  const vector<string> &keys);
+  // checks every key of proof against its value, a key with an empty value
+  // must be absent from the trie
+  bool VerifyMultiProof(uint64_t tid, const string &root_hash,
+                        const DMMTrieMultiProof &proof);
   void Flush(uint64_t tid, uint64_t version);
   void Revert(uint64_t tid, uint64_t version);
+
+  static constexpr size_t kDefaultCacheBytes = size_t(4) << 30;  // 4GB
+  // pids of up to 4 nibbles: the root and the two levels below it
+  static constexpr size_t kDefaultPinnedLevels = 3;
   DeltaPage *GetDeltaPage(const string &pid);
   pair<uint64_t, uint64_t> GetPageVersion(PageKey pagekey);
   PageKey GetLatestBasePageKey(PageKey pagekey) const;
@@ -238,33 +371,185 @@ class DMMTrie {
                          uint64_t latest_basepage_version);
   void WritePageCache(PageKey pagekey, Page *page);
   void AddDeltaPageVersion(const string &pid, uint64_t version);
-  uint64_t GetVersionUpperbound(const string &pid, uint64_t version);
+  // the pages to replay for pid at version: the newest basepage not after
+  // version (0 for none) and the deltapages after it up to version.
+  // next_version is the first later version a page of pid was stored at, 0
+  // when there is none
+  void GetReplayVersions(const string &pid, uint64_t version,
+                         uint64_t &base_version,
+                         vector<uint64_t> &delta_versions,
+                         uint64_t &next_version);
 
  private:
+  friend class DMMTrieIterator;
+
+  // held by a read for as long as it uses page pointers. It waits for the
+  // commit of version when that is still running
+  class ReadGuard {
+   public:
+    ReadGuard(DMMTrie *trie, uint64_t version);
+    ~ReadGuard();
+
+   private:
+    DMMTrie *trie_;
+  };
+
+  // the work of one page in a commit. Prepare and Finish touch the caches and
+  // stores and run serially; Apply only touches the page itself and its
+  // deltapage, so pages with the same pid length can be applied in parallel
+  struct PageUpdate {
+    string pid;
+    const WriteBuffer::NibbleGroup *groups;  // nibbles of the page
+    size_t group_count;
+    BasePage *page;
+    DeltaPage *deltapage;
+    PageKey pagekey;
+    PageKey old_pagekey;
+    bool if_exceed;
+    vector<tuple<uint64_t, uint64_t, uint64_t>> locations;  // one per group
+    // value hash for leaf updates, root hash of the child page otherwise
+    vector<Digest> hashes;
+    // the child pages of the index groups, in group order. They are updated
+    // earlier in the same commit and pass their root hash up directly
+    const PageUpdate *children;
+    Digest root_hash;  // root hash of the page after this commit
+  };
+
   LSVPS *page_store_;
   VDLS *value_store_;
   uint64_t tid;
   BasePage *root_page_;
-  uint64_t current_version_;
-  unordered_map<PageKey, list<pair<PageKey, BasePage *>>::iterator,
-                PageKey::Hash>
-      lru_cache_;                             //  use a hash map as lru cache
-  list<pair<PageKey, BasePage *>> pagekeys_;  // list to maintain cache order
-  const size_t max_cache_size_ = 3000000;     // maximum pages in cache
+  atomic<uint64_t> current_version_;  // also read by the commit thread
+  PageCache lru_cache_;  // sharded cache of basepages
+  // shared by readers, exclusive while a commit changes cached pages
+  shared_mutex page_mutex_;
+  atomic<bool> writer_waiting_;  // new readers let a waiting commit go first
+  atomic<uint64_t> committed_version_;  // newest version readers can see
+  atomic<bool> commit_failed_;  // a CommitAsync threw, pending_commit_ holds it
   unordered_map<string, DeltaPage>
       active_deltapages_;  // deltapage of all pages, delta pages are indexed by
                            // pid
   unordered_map<string, pair<uint64_t, uint64_t>>
       page_versions_;  // current version, latest basepage version
   map<PageKey, Page *> page_cache_;
-  map<string, string> put_cache_;  // temporarily store the key of value of Put
+  WriteBuffer write_buffer_;  // puts and deletes of the current version
+  WriteBuffer commit_buffer_;  // writes of the version CommitAsync is running
+  shared_future<string> pending_commit_;  // the last CommitAsync
+  mutex pending_mutex_;  // guards pending_commit_, read by reader threads
+  unique_ptr<LatestIndex> latest_index_;  // nullptr when disabled
+  unique_ptr<KeyFilter> key_filter_;      // nullptr when disabled
+  uint64_t key_filter_version_;  // first version the filter answers for
+  // second tier of lru_cache_, nullptr when disabled
+  unique_ptr<CompressedCache> compressed_cache_;
   unordered_map<string, vector<uint64_t>>
       deltapage_versions_;  // the versions of deltapages for every pid
+  unordered_map<string, vector<uint64_t>>
+      basepage_versions_;  // the versions of basepages for every pid
+  unique_ptr<ThreadPool> commit_pool_;  // nullptr means serial commit
+  mutex commit_mutex_;  // guards the bookkeeping UpdatePage calls back into
 
+  // retired pages a reader tries to free when it leaves
+  static constexpr size_t kRetiredPagesThreshold = 1024;
+
+  unique_lock<shared_mutex> LockPages();  // exclusive, ahead of new readers
+  bool CheckWriteVersion(uint64_t version);
+  void CommitWriteBuffer(uint64_t version, WriteBuffer &buffer);
+  bool CheckKey(string_view key);
   BasePage *GetPage(const PageKey &pagekey);
+  // pid is only used to load the page from LSVPS on a cache miss
+  BasePage *GetPage(const PackedPageKey &pagekey, string_view pid);
   void PutPage(const PageKey &pagekey, BasePage *page);
   void UpdatePageKey(const PageKey &old_pagekey, const PageKey &new_pagekey);
-  string RecursiveVerify(PageKey pagekey);
+  Digest RecursiveVerify(PageKey pagekey);
+  void MultiGetPage(uint64_t version, size_t depth, const vector<string> &keys,
+                    const size_t *order, size_t begin, size_t end,
+                    vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>>
+                        &locations);
+  // append the proof of proof.keys[begin, end), which share their first
+  // depth nibbles. ProvePage returns false when the page cannot prove them
+  bool ProvePage(uint64_t version, size_t depth, DMMTrieMultiProof &proof,
+                 size_t begin, size_t end,
+                 vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>>
+                     &locations);
+  void ProveNode(Node *node, bool second_level, size_t depth,
+                 DMMTrieMultiProof &proof, size_t begin, size_t end,
+                 vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>>
+                     &locations);
+  // computes the hash of proof.nodes[next], false when the proof is invalid
+  bool VerifyProofNode(const DMMTrieMultiProof &proof, size_t depth,
+                       size_t begin, size_t end, size_t &next, Digest &hash);
+  // reads the value of every (location, index) pair into values[index] in
+  // log order, reads of the same location are shared
+  void ReadValues(
+      vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> &locations,
+      vector<string> &values);
+  void LinkChildPages(vector<PageUpdate> &page_updates);
+  void HashLeafValues(vector<PageUpdate> &page_updates);
+  void WriteLeafValues(uint64_t version, vector<PageUpdate> &page_updates);
+  void UpdateLatestIndex(uint64_t version,
+                         const vector<PageUpdate> &page_updates);
+  const LatestIndex::Entry *FindLatest(uint64_t version,
+                                       const string &key) const;
+  void UpdateKeyFilter(const WriteBuffer &buffer);
+  // false when the key filter proves key was not written up to version
+  bool MayContain(uint64_t version, string_view key) const;
+  void PreparePageUpdate(uint64_t version, PageUpdate &update);
+  void ApplyPageUpdate(uint64_t version, PageUpdate &update);
+  void FinishPageUpdate(uint64_t version, PageUpdate &update);
+};
+
+// in-order walk over the leaves of one version. The leaves are collected in
+// windows: each refill descends from the root once, skips the subtrees
+// outside the bound by comparing prefixes, and reads the values of the whole
+// window from VDLS in log order. Windows double while the scan goes on in the
+// same direction. Deleted keys are skipped and keys are returned in lower
+// case hex. No page pointer is kept between calls, so commits may run while
+// an iterator is open.
+class DMMTrieIterator {
+ public:
+  DMMTrieIterator(DMMTrie *trie, uint64_t version, const string &begin,
+                  const string &end);
+
+  bool Valid() const;
+  void SeekToFirst();
+  void SeekToLast();
+  void Seek(const string &key);  // first key not less than key
+  void Next();
+  void Prev();
+  const string &Key() const;
+  const string &Value() const;
+
+  static constexpr size_t kMinWindow = 16;
+  static constexpr size_t kMaxWindow = 1024;
+
+ private:
+  // replaces the window with the keys after bound (forward) or before bound
+  // (backward), inclusive decides whether bound itself qualifies. Without
+  // bounded the scan starts at the first (or last) key of the range
+  void Fill(string bound, bool inclusive, bool forward, bool bounded);
+  // the Scan functions and Emit return true when the window is full or the
+  // range is exhausted
+  bool ScanPage(uint64_t page_version, bool bounded);
+  bool ScanIndex(Node *node, bool second_level, bool bounded);
+  bool Emit(Node *leaf, bool bounded);
+  // -1, 0, 1 when path_ sorts before, as or after the same-length prefix of
+  // the bound
+  int ComparePath() const;
+
+  DMMTrie *trie_;
+  uint64_t version_;
+  string begin_;
+  string end_;  // "" means no upper bound
+  vector<string> keys_;  // the window in key order
+  vector<string> values_;
+  size_t pos_;
+  size_t window_;
+  // state of the running Fill
+  string path_;
+  const string *bound_;
+  bool inclusive_;
+  bool forward_;
+  vector<pair<string, tuple<uint64_t, uint64_t, uint64_t>>> leaves_;
 };
 
 #endif
\ No newline at end of file
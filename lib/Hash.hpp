@@ -0,0 +1,124 @@
+#ifndef _HASH_HPP_
+#define _HASH_HPP_
+
+#include <openssl/sha.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "Blake3.hpp"
+
+// hash algorithms the trie can be built with, the id is recorded in every
+// serialized page
+enum class HashAlgorithm : uint8_t { kSHA1 = 1, kSHA256 = 2, kBLAKE3 = 3 };
+
+struct SHA1Policy {
+  static constexpr HashAlgorithm kAlgorithm = HashAlgorithm::kSHA1;
+  static constexpr size_t kDigestSize = SHA_DIGEST_LENGTH;
+  static constexpr const char *kName = "sha1";
+  static void Hash(const char *data, size_t size, unsigned char *out) {
+    SHA1(reinterpret_cast<const unsigned char *>(data), size, out);
+  }
+};
+
+struct SHA256Policy {
+  static constexpr HashAlgorithm kAlgorithm = HashAlgorithm::kSHA256;
+  static constexpr size_t kDigestSize = SHA256_DIGEST_LENGTH;
+  static constexpr const char *kName = "sha256";
+  static void Hash(const char *data, size_t size, unsigned char *out) {
+    SHA256(reinterpret_cast<const unsigned char *>(data), size, out);
+  }
+};
+
+struct BLAKE3Policy {
+  static constexpr HashAlgorithm kAlgorithm = HashAlgorithm::kBLAKE3;
+  static constexpr size_t kDigestSize = BLAKE3_OUT_LEN;
+  static constexpr const char *kName = "blake3";
+  static void Hash(const char *data, size_t size, unsigned char *out) {
+    Blake3Hash(data, size, out);
+  }
+};
+
+// the policy is fixed at compile time, select it with
+// cmake -DLETUS_HASH=SHA1|SHA256|BLAKE3
+#if defined(LETUS_HASH_SHA256)
+using HashPolicy = SHA256Policy;
+#elif defined(LETUS_HASH_BLAKE3)
+using HashPolicy = BLAKE3Policy;
+#else
+using HashPolicy = SHA1Policy;
+#endif
+
+// width of the digests produced by the active hash policy
+static constexpr size_t HASH_SIZE = HashPolicy::kDigestSize;
+
+// fixed-size binary digest stored by value in nodes, deltapages and proofs.
+// The all-zero digest stands for "no hash" (empty child, deleted leaf): it
+// converts to the empty string and is skipped when child hashes are
+// concatenated, which keeps node hashes identical to the string encoding.
+struct Digest {
+  std::array<unsigned char, HASH_SIZE> bytes;
+
+  Digest() : bytes{} {}
+
+  static constexpr size_t size() { return HASH_SIZE; }
+  const char *data() const { return reinterpret_cast<const char *>(&bytes[0]); }
+  char *data() { return reinterpret_cast<char *>(&bytes[0]); }
+
+  bool IsEmpty() const {
+    for (unsigned char b : bytes) {
+      if (b != 0) return false;
+    }
+    return true;
+  }
+
+  // "" maps to the empty digest, other strings must be HASH_SIZE bytes long
+  static Digest FromString(const std::string &str) {
+    Digest digest;
+    if (str.size() == HASH_SIZE) {
+      memcpy(digest.data(), str.data(), HASH_SIZE);
+    }
+    return digest;
+  }
+
+  std::string ToString() const {
+    return IsEmpty() ? std::string() : std::string(data(), HASH_SIZE);
+  }
+
+  bool operator==(const Digest &other) const { return bytes == other.bytes; }
+  bool operator!=(const Digest &other) const { return bytes != other.bytes; }
+};
+
+static_assert(std::is_trivially_copyable<Digest>::value,
+              "Digest must be trivially copyable");
+
+Digest HashDigest(const char *data, size_t size);
+std::string HashFunction(const std::string &input);
+
+// one message of a batch, the bytes are not copied
+struct HashMessage {
+  const char *data;
+  size_t size;
+};
+
+// kernels HashBatch can run on. kSHANI interleaves two messages on the SHA
+// extensions, kAVX2 hashes eight messages in the lanes of 256-bit registers,
+// kScalar calls HashDigest once per message. The SIMD kernels implement
+// SHA-1 only, other policies always run on kScalar
+enum class HashKernel { kScalar, kAVX2, kSHANI };
+
+bool HashKernelSupported(HashKernel kernel);
+const char *HashKernelName(HashKernel kernel);
+// widest kernel supported by this CPU, used for full batches
+HashKernel ActiveHashKernel();
+
+// digests[i] = HashDigest(messages[i]) for i in [0, count), computed together
+// on a kernel chosen at runtime from the CPU features and the batch size
+void HashBatch(const HashMessage *messages, size_t count, Digest *digests);
+void HashBatch(const HashMessage *messages, size_t count, Digest *digests,
+               HashKernel kernel);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _KEYFILTER_HPP_
+#define _KEYFILTER_HPP_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Bloom filter over the keys written to the trie, so lookups of keys that
+// were never written skip the page walk. Keys are only added, a deleted key
+// stays a possible member. The filter grows by adding layers, each twice the
+// capacity of the last with half its false-positive rate, which keeps the
+// total rate below the configured one without rehashing older keys. Every
+// layer is split into 64-byte blocks and a key only probes one block.
+class KeyFilter {
+ public:
+  // fp_rate is the target false-positive rate, expected_keys the capacity of
+  // the first layer
+  explicit KeyFilter(double fp_rate = 0.01, size_t expected_keys = 1 << 20);
+
+  void Add(string_view key);
+  bool MayContain(string_view key) const;  // false means never added
+
+  // the file holds the filter and version, the version the keys were added
+  // up to. LoadFrom fails when the file is missing or malformed
+  void SaveTo(const string &filepath, uint64_t version) const;
+  bool LoadFrom(const string &filepath, uint64_t &version);
+
+  double FalsePositiveRate() const;  // the configured rate
+  // expected rate for the keys added so far
+  double EstimatedFalsePositiveRate() const;
+  size_t Size() const;         // number of keys added
+  size_t Layers() const;
+  size_t MemoryUsage() const;  // bytes of all layers
+
+ private:
+  struct Layer {
+    vector<uint64_t> bits;  // kWordsPerBlock words per block
+    size_t blocks;
+    size_t capacity;
+    size_t size;
+    uint32_t probes;  // bits set per key
+  };
+
+  static uint64_t Mix(uint64_t h);
+  static uint64_t HashKey(string_view key);
+  // the first word of the block of hash in layer
+  static size_t BlockOf(const Layer &layer, uint64_t hash);
+  static bool Probe(const Layer &layer, uint64_t hash);
+  static double BlockRate(double keys_per_block, uint32_t probes);
+  void AddLayer();
+
+  double fp_rate_;
+  size_t expected_keys_;
+  size_t size_;
+  vector<Layer> layers_;
+
+  static constexpr size_t kWordsPerBlock = 8;  // 512 bits, one cache line
+  static constexpr double kMaxBitsPerKey = 64;
+  static constexpr uint64_t kBitSeed = 0x9e3779b97f4a7c15ULL;
+};
+
+#endif
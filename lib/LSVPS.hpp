@@ -1,9 +1,17 @@
 #ifndef _LSVPS_H_
 #define _LSVPS_H_
 
+#include <atomic>
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <set>
+#include <shared_mutex>
 #include <string>
+#include <tuple>
+#include <unordered_set>
 #include <vector>
 
 #include "DMMTrie.hpp"
@@ -58,17 +66,36 @@ class LSVPS {
       : cache_(),
         table_(*this),
         index_file_path_(index_file_path),
-        active_delta_page_cache_(4096, index_file_path) {}
+        active_delta_page_cache_(4096, index_file_path),
+        historical_page_cache_(4096) {}
   Page *PageQuery(uint64_t version);
   BasePage *LoadPage(const PageKey &pagekey);
   void StorePage(Page *page);
+  // takes ownership of page and adds it to the memtable without flushing, so
+  // a commit can make its pages visible to loads while readers are held off
+  // and write them with FlushTableIfFull once they are let in again
+  void AdoptPage(Page *page);
+  void FlushTableIfFull();
   void AddIndexFile(const IndexFile &index_file);
   int GetNumOfIndexFile();
+  const std::string &GetIndexFilePath() const;
   void RegisterTrie(DMMTrie *DMM_trie);
   const std::vector<Page *> &GetTable() const;
   void Flush();
   void StoreActiveDeltaPage(DeltaPage *page);
   DeltaPage *GetActiveDeltaPage(const string &pid);
+  // a copy of the deltapage of pid frozen at version, nullptr when it is not
+  // stored. Used to read the writes of a version without rebuilding the page
+  std::unique_ptr<DeltaPage> LoadDeltaPage(const string &pid,
+                                           uint64_t version);
+  // a pinned active deltapage is never evicted, so a commit can hold the
+  // pointers of a whole batch of pages until it unpins them
+  void PinActiveDeltaPage(const string &pid);
+  void UnpinActiveDeltaPages();
+  // hits rebuild nothing, floor hits replay only the deltas after a cached
+  // page of an earlier version
+  void GetHistoricalPageCacheStats(uint64_t &hits, uint64_t &floor_hits,
+                                   uint64_t &misses) const;
 
  private:
   // 块缓存类（占位）
@@ -81,12 +108,15 @@ class LSVPS {
     const std::vector<Page *> &GetBuffer() const;
     void Store(Page *page);
     bool IsFull() const;
-    void Flush();
+    void Flush();      // writes all pages
+    void FlushFull();  // writes index files of max_size_ pages while full
 
    private:
-    void writeToStorage(const std::filesystem::path &filepath);
+    void flushChunk(size_t count);
+    void writeToStorage(const std::filesystem::path &filepath, size_t count);
     std::vector<Page *> buffer_;
-    // gurantee that max_size >= one version pages
+    // an index file holds at most max_size_ pages, the buffer may hold more
+    // until a commit flushes it
     // max number of entries in lookup block = 126, 126^2 = 15876
     const size_t max_size_ = 15876;
     // const size_t max_size_ = 16;
@@ -99,6 +129,8 @@ class LSVPS {
     ~ActiveDeltaPageCache();
     void Store(DeltaPage *page);
     DeltaPage *Get(const string &pid);
+    void Pin(const string &pid);
+    void UnpinAll();
     // TODO: DeltaPage* GetNewPage();
     void FlushToDisk();
 
@@ -119,6 +151,7 @@ class LSVPS {
     unordered_map<string, size_t> pid_to_offset_;  // Maps pid to file offset
     unordered_map<string, PageKey>
         pid_to_last_pagekey_;  // Maps pid to last pagekey
+    std::unordered_set<string> pinned_;  // pids that must not be evicted
 
     const size_t max_size_;        // 缓存最大容量
     std::string cache_dir_;        // 磁盘缓存目录
@@ -126,16 +159,78 @@ class LSVPS {
     std::list<string> lru_queue_;  // 用于LRU淘汰策略
   };
 
+  // pages rebuilt by LoadPage, each valid for the versions
+  // [first_version, next_version) between two changes of the page. Eviction
+  // is GreedyDual: a page is worth its replay cost plus the cost of the last
+  // evicted page, so pages with long delta chains stay longer. Safe to call
+  // from many threads, the pages are copied in and out under its own lock.
+  class HistoricalPageCache {
+   public:
+    static constexpr uint64_t kOpenVersion = UINT64_MAX;  // not changed yet
+
+    explicit HistoricalPageCache(size_t max_size);
+    ~HistoricalPageCache();
+    // a copy of the page of pid at version, nullptr on a miss
+    BasePage *Get(const string &pid, uint64_t version);
+    // a copy of the newest page of pid changed before version to replay the
+    // rest from, first_version is set to its version. nullptr when none
+    BasePage *GetFloor(const string &pid, uint64_t version,
+                       uint64_t &first_version);
+    // keeps a copy of page, cost is the number of pages and delta items read
+    // to rebuild it
+    void Store(const string &pid, uint64_t first_version,
+               uint64_t next_version, const BasePage *page, uint64_t cost);
+    uint64_t Hits() const;
+    uint64_t FloorHits() const;
+    uint64_t Misses() const;
+
+   private:
+    struct Entry {
+      BasePage *page;
+      uint64_t next_version;
+      uint64_t cost;
+      uint64_t priority;
+    };
+    void evict();
+    void touch(const string &pid, uint64_t first_version, Entry &entry);
+
+    mutable std::mutex mutex_;
+    const size_t max_size_;
+    size_t size_;
+    uint64_t inflation_;  // priority of the last evicted page
+    uint64_t hits_;
+    uint64_t floor_hits_;
+    uint64_t misses_;
+    // pid -> first_version -> page
+    unordered_map<string, std::map<uint64_t, Entry>> pages_;
+    // (priority, pid, first_version), lowest priority is evicted first
+    std::set<std::tuple<uint64_t, string, uint64_t>> queue_;
+  };
+
   Page *pageLookup(const PageKey &pagekey);
   Page *readPageFromIndexFile(std::vector<IndexFile>::const_iterator file_it,
                               const PageKey &pagekey);
-  void applyDelta(BasePage *basepage, const DeltaPage *deltapage,
-                  PageKey pagekey);
+  // applies the items after start_version up to pagekey. Returns the version
+  // of the first item newer than pagekey, or
+  // HistoricalPageCache::kOpenVersion when there is none
+  uint64_t applyDelta(BasePage *basepage, const DeltaPage *deltapage,
+                      PageKey pagekey, uint64_t start_version, uint64_t &cost);
+  std::unique_lock<std::shared_mutex> LockStore();  // ahead of new loads
+  std::shared_lock<std::shared_mutex> ShareStore();
 
   blockCache cache_;
   MemIndexTable table_;
   std::string index_file_path_;
   ActiveDeltaPageCache active_delta_page_cache_;
+  HistoricalPageCache historical_page_cache_;
+  // the memtable and the index files only change under an exclusive lock, in
+  // StorePage and Flush. Loads read them under a shared lock, so the disk
+  // lookups and replays of reader threads run in parallel
+  mutable std::shared_mutex store_mutex_;
+  std::atomic<bool> writer_waiting_{false};  // new loads let a flush go first
+  // a load copies the active deltapage under this lock, as the load of
+  // another reader may evict it from active_delta_page_cache_
+  std::mutex active_mutex_;
   DMMTrie *trie_;
   std::vector<IndexFile> index_files_;
 };
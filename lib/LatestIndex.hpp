@@ -0,0 +1,65 @@
+#ifndef _LATESTINDEX_HPP_
+#define _LATESTINDEX_HPP_
+
+#include <cstdint>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "Hash.hpp"
+
+using namespace std;
+
+// flat index of the newest committed state: key -> (version, VDLS location,
+// leaf hash). It is updated at the end of every commit and only answers reads
+// at the version it was last published for, older versions use the trie.
+// The index is an open-addressing table with the keys in one arena. With a
+// byte budget, keys that do not fit are simply not indexed and their reads
+// fall back to the trie; keys already indexed are always kept up to date.
+class LatestIndex {
+ public:
+  struct Entry {
+    uint64_t version;  // version of the last write of the key
+    tuple<uint64_t, uint64_t, uint64_t> location;  // fileID, offset, size
+    Digest hash;  // hash of the value, empty for deleted keys
+  };
+
+  explicit LatestIndex(size_t max_bytes = 0);  // 0 means unbounded
+
+  void Update(uint64_t version, string_view key,
+              const tuple<uint64_t, uint64_t, uint64_t> &location,
+              const Digest &value_hash);
+  void Publish(uint64_t version);  // all updates of version are applied
+  uint64_t Version() const;        // version reads can be answered for
+  bool Published() const;
+  const Entry *Find(string_view key) const;  // nullptr when not indexed
+
+  size_t Size() const;         // number of indexed keys
+  size_t Skipped() const;      // writes not indexed because of the budget
+  size_t MemoryUsage() const;  // bytes of the table and the key arena
+  size_t MaxBytes() const;
+
+ private:
+  struct Slot {
+    uint64_t key_hash;
+    uint64_t key_offset;  // offset in keys_
+    uint32_t key_size;
+    bool used;
+    Entry entry;
+  };
+
+  size_t FindSlot(string_view key, uint64_t key_hash) const;
+  bool Grow();
+
+  size_t max_bytes_;
+  vector<Slot> slots_;  // size is zero or a power of two
+  vector<char> keys_;
+  size_t size_;
+  size_t skipped_;
+  uint64_t version_;
+  bool published_;
+
+  static constexpr size_t kInitialSlots = 1024;
+};
+
+#endif
@@ -5,14 +5,48 @@
 
 typedef struct Letus Letus;
 typedef struct LetusProofPath LetusProofPath;
+typedef struct LetusIterator LetusIterator;
 
+// once a background commit failed (see LetusCommitAsync) every read fails:
+// calls returning a pointer return NULL, with *size 0 where there is one, and
+// calls returning bool return false. An iterator whose read failed is not
+// valid, a NULL iterator is accepted and never valid
 extern struct Letus* OpenLetus(const char* path_c);
 void LetusPut(Letus* p, uint64_t tid, uint64_t version, const char* key_c,
               const char* value_c);
 void LetusDelete(Letus* p, uint64_t tid, uint64_t version, const char* key_c);
 char* LetusGet(Letus* p, uint64_t tid, uint64_t version, const char* key_c);
+// the value without copying it: *size bytes that stay valid while p is open,
+// not null terminated. *size is 0 when the key is not found, NULL is only
+// returned when the read failed
+const char* LetusGetView(Letus* p, uint64_t tid, uint64_t version,
+                         const char* key_c, uint64_t* size);
+// reads count keys at one version, values[i] receives a null terminated copy
+// of the value of keys[i] ("" when not found). Release with LetusFreeValues
+bool LetusMultiGet(Letus* p, uint64_t tid, uint64_t version,
+                   const char** keys_c, uint64_t count, char** values);
+void LetusFreeValues(char** values, uint64_t count);
+// ordered scan over the keys in [begin_c, end_c) at version, an empty end_c
+// means no upper bound. Position it with one of the Seek calls first. Key and
+// value are returned as null terminated copies, like LetusGet
+LetusIterator* LetusNewIterator(Letus* p, uint64_t tid, uint64_t version,
+                                const char* begin_c, const char* end_c);
+bool LetusIteratorValid(LetusIterator* it);
+void LetusIteratorSeek(LetusIterator* it, const char* key_c);
+void LetusIteratorSeekToFirst(LetusIterator* it);
+void LetusIteratorSeekToLast(LetusIterator* it);
+void LetusIteratorNext(LetusIterator* it);
+void LetusIteratorPrev(LetusIterator* it);
+char* LetusIteratorKey(LetusIterator* it);
+char* LetusIteratorValue(LetusIterator* it);
+void LetusDeleteIterator(LetusIterator* it);
 bool LetusRevert(Letus* p, uint64_t tid, uint64_t version);
 bool LetusCalcRootHash(Letus* p, uint64_t tid, uint64_t version);
+// starts the commit of version in the background, LetusGetRootHash and the
+// other reads wait for it to finish. A failed background commit makes the
+// next LetusCommitAsync, LetusCalcRootHash or LetusFlush return false and
+// LetusGetRootHash return NULL
+bool LetusCommitAsync(Letus* p, uint64_t tid, uint64_t version);
 char* LetusGetRootHash(Letus* p, uint64_t tid, uint64_t version);
 bool LetusFlush(Letus* p, uint64_t tid, uint64_t version);
 LetusProofPath* LetusProof(Letus* p, uint64_t tid, uint64_t version,
@@ -27,4 +61,16 @@ char* LetusGetINodeKey(LetusProofPath* path, uint64_t node_index,
                        uint64_t inode_index);
 char* LetusGetINodeHash(LetusProofPath* path, uint64_t node_index,
                         uint64_t inode_index);
+// proves count keys at version with one deduplicated proof, serialized into
+// a buffer of *size bytes. Release it with LetusFreeBuffer
+char* LetusMultiProof(Letus* p, uint64_t tid, uint64_t version,
+                      const char** keys_c, uint64_t count, uint64_t* size);
+// checks a serialized multi-key proof against a binary root hash
+bool LetusVerifyMultiProof(Letus* p, uint64_t tid, const char* root_hash_c,
+                           const char* proof_c, uint64_t size);
+void LetusFreeBuffer(char* buffer);
+// hashes returned above are binary digests of LetusGetHashSize() bytes, an
+// all-zero digest stands for an empty child
+const char* LetusGetHashAlgorithm();
+uint64_t LetusGetHashSize();
 #endif  // _LETUS_H_
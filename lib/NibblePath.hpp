@@ -0,0 +1,131 @@
+#ifndef _NIBBLEPATH_HPP_
+#define _NIBBLEPATH_HPP_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "common.hpp"
+
+// longest pid (and key) the packed representation holds
+static constexpr size_t kMaxPidNibbles = 128;
+
+// hexadecimal digit to nibble 0~15, -1 for other characters
+inline int NibbleOf(char ch) {
+  if (ch >= '0' && ch <= '9') {
+    return ch - '0';
+  } else if (ch >= 'a' && ch <= 'f') {
+    return ch - 'a' + 10;
+  } else if (ch >= 'A' && ch <= 'F') {
+    return ch - 'A' + 10;
+  }
+  return -1;
+}
+
+// PageKey with the pid packed two nibbles per byte into an inline array, so
+// building, hashing and comparing it never allocates. pid_hash is computed
+// once, incrementally over the nibbles of the pid.
+struct PackedPageKey {
+  uint64_t version;
+  uint64_t tid;
+  bool type;
+  uint8_t size;  // number of nibbles in pid
+  uint64_t pid_hash;
+  std::array<uint8_t, kMaxPidNibbles / 2> pid;  // unused nibbles are zero
+
+  static constexpr uint64_t kHashBasis = 14695981039346656037ULL;  // FNV-1a
+  static constexpr uint64_t kHashPrime = 1099511628211ULL;
+
+  static uint64_t ExtendHash(uint64_t hash, int nibble) {
+    return (hash ^ uint64_t(nibble)) * kHashPrime;
+  }
+
+  bool operator==(const PackedPageKey &other) const {
+    return version == other.version && tid == other.tid &&
+           type == other.type && size == other.size &&
+           pid_hash == other.pid_hash &&
+           memcmp(pid.data(), other.pid.data(), (size + 1) / 2) == 0;
+  }
+
+  struct Hash {
+    size_t operator()(const PackedPageKey &key) const {
+      uint64_t h = key.pid_hash;
+      h ^= key.version + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+      h ^= (key.tid << 1) ^ uint64_t(key.type);
+      return size_t(h);
+    }
+  };
+
+  // throws when pid is too long or is not made of hexadecimal digits, neither
+  // of which can be stored in the trie
+  static PackedPageKey FromPageKey(const PageKey &pagekey) {
+    if (pagekey.pid.size() > kMaxPidNibbles) {
+      throw std::runtime_error("pid longer than " +
+                               std::to_string(kMaxPidNibbles) + " nibbles");
+    }
+    PackedPageKey key{pagekey.version, pagekey.tid, pagekey.type,
+                      uint8_t(pagekey.pid.size()), kHashBasis, {}};
+    for (size_t i = 0; i < pagekey.pid.size(); i++) {
+      int nibble = NibbleOf(pagekey.pid[i]);
+      if (nibble < 0) {
+        throw std::runtime_error("pid is not hexadecimal: " + pagekey.pid);
+      }
+      key.pid[i / 2] |= i % 2 ? nibble : nibble << 4;
+      key.pid_hash = ExtendHash(key.pid_hash, nibble);
+    }
+    return key;
+  }
+};
+
+// a key decoded once for a read: its nibbles, packed, and the pid hash of
+// every prefix, so the PackedPageKey of each page on the path is a copy
+class NibblePath {
+ public:
+  explicit NibblePath(std::string_view key) : key_(key), valid_(true) {
+    if (key.size() > kMaxPidNibbles) {
+      valid_ = false;
+      return;
+    }
+    packed_.fill(0);
+    prefix_hash_[0] = PackedPageKey::kHashBasis;
+    for (size_t i = 0; i < key.size(); i++) {
+      int nibble = NibbleOf(key[i]);
+      if (nibble < 0) {
+        valid_ = false;
+        return;
+      }
+      nibbles_[i] = uint8_t(nibble);
+      packed_[i / 2] |= i % 2 ? nibble : nibble << 4;
+      prefix_hash_[i + 1] = PackedPageKey::ExtendHash(prefix_hash_[i], nibble);
+    }
+  }
+
+  bool Valid() const { return valid_; }
+  size_t Size() const { return key_.size(); }
+  int Nibble(size_t i) const { return nibbles_[i]; }
+  std::string_view Prefix(size_t size) const { return key_.substr(0, size); }
+
+  // the key of the page whose pid is the first pid_size nibbles
+  PackedPageKey PageKeyAt(uint64_t version, uint64_t tid, bool type,
+                          size_t pid_size) const {
+    PackedPageKey key{version, tid, type, uint8_t(pid_size),
+                      prefix_hash_[pid_size], {}};
+    memcpy(key.pid.data(), packed_.data(), pid_size / 2);
+    if (pid_size % 2) {
+      key.pid[pid_size / 2] = packed_[pid_size / 2] & 0xf0;
+    }
+    return key;
+  }
+
+ private:
+  std::string_view key_;
+  bool valid_;
+  std::array<uint8_t, kMaxPidNibbles> nibbles_;
+  std::array<uint8_t, kMaxPidNibbles / 2> packed_;
+  std::array<uint64_t, kMaxPidNibbles + 1> prefix_hash_;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef _PAGECACHE_HPP_
+#define _PAGECACHE_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "CachePolicy.hpp"
+#include "NibblePath.hpp"
+
+using namespace std;
+
+class BasePage;
+class CompressedCache;
+
+// open-addressing index of the entries of one cache shard, with linear
+// probing and backward-shift deletion. The entries live in a pool and keep
+// their address while they are cached, so the policies can link them
+class PageTable {
+ public:
+  PageTable();
+
+  CacheEntry *Find(const PackedPageKey &key);  // nullptr when absent
+  // a cleared entry for key, which must be absent
+  CacheEntry *Emplace(const PackedPageKey &key);
+  void Erase(CacheEntry *entry);
+  // gives entry the key, which must be absent. The entry stays in place
+  void Rekey(CacheEntry *entry, const PackedPageKey &key);
+  size_t Size() const { return size_; }
+  template <typename F>
+  void ForEach(F f) {
+    for (const Slot &slot : slots_) {
+      if (slot.entry != 0) {
+        f(pool_[slot.entry - 1]);
+      }
+    }
+  }
+
+ private:
+  struct Slot {
+    uint32_t tag;    // the high half of the key hash
+    uint32_t entry;  // index into pool_ plus one, 0 for a free slot
+  };
+
+  static uint32_t TagOf(const PackedPageKey &key);
+  // the slot of key, or the free slot its probe ends at
+  size_t SlotOf(const PackedPageKey &key, uint32_t tag) const;
+  void Place(uint32_t tag, uint32_t entry);
+  void Unplace(size_t slot);
+  void Grow();
+
+  vector<Slot> slots_;  // the size is a power of two
+  uint32_t bits_;       // log2 of the number of slots
+  deque<CacheEntry> pool_;
+  vector<uint32_t> free_;  // unused indexes of pool_
+  size_t size_;
+};
+
+// the basepages of a trie by PackedPageKey. The cache is split into shards
+// by pid hash, each with its own lock, PageTable and replacement policy, so
+// readers of different pages do not contend and all versions of a page are
+// rekeyed inside one shard. Its budget is in bytes: every page is measured
+// when it is cached and again after a commit changed it, and each shard
+// evicts the pages its policy picks while it is over its share of the
+// budget. A page leaving the cache may still be used by a running reader,
+// so it is retired instead of deleted; the owner calls ReleaseRetired() once
+// no reader can hold a page.
+//
+// The newest basepages of the first pinned_levels page levels, which every
+// read and commit walks through, are kept apart in a pinned tier that
+// is never evicted and not charged to the budget. A lookup there takes no
+// lock. Pinned pages are changed in place, so Put and Rekey of pinnable keys
+// must not run concurrently with readers; DMMTrie only calls them during a
+// commit, which holds off the readers.
+class PageCache {
+ public:
+  explicit PageCache(size_t max_bytes,
+                     CachePolicyType policy = CachePolicyType::kCLOCK,
+                     size_t pinned_levels = 0,
+                     size_t shards = kDefaultShards);
+  PageCache(size_t max_bytes, const CachePolicyFactory &policy,
+            size_t pinned_levels = 0, size_t shards = kDefaultShards);
+  ~PageCache();  // deletes the cached and the retired pages
+
+  BasePage *Get(const PackedPageKey &key);  // nullptr on a miss
+  // caches page unless another page is cached under key already, in which
+  // case page is deleted. Returns the cached page
+  BasePage *Insert(const PackedPageKey &key, BasePage *page);
+  void Put(const PackedPageKey &key, BasePage *page);  // replaces
+  // moves the page of old_key to new_key and measures it again, as it may
+  // have changed in place. When old_key is not cached the page of new_key,
+  // if any, is measured again
+  void Rekey(const PackedPageKey &old_key, const PackedPageKey &new_key);
+  void ReleaseRetired();  // only when no reader holds a page of this cache
+  // pages evicted from now on are compressed into tier, which Put and Rekey
+  // keep free of stale copies. nullptr turns it off. Must not run
+  // concurrently with other calls
+  void SetSecondTier(CompressedCache *tier);
+
+  size_t RetiredCount() const;
+  size_t Size() const;         // number of cached pages, without pinned ones
+  size_t MemoryUsage() const;  // bytes of the cached pages
+  size_t MaxBytes() const;
+  // Get calls that found or missed the page outside the pinned tier
+  uint64_t Hits() const;
+  uint64_t Misses() const;
+  size_t PinnedSize() const;
+  size_t PinnedMemoryUsage() const;
+  size_t PinnedLevels() const;
+
+  static constexpr size_t kDefaultShards = 64;
+  static constexpr size_t kMaxPinnedLevels = 4;
+
+ private:
+  struct Shard {
+    mutable mutex shard_mutex;
+    PageTable index;
+    unique_ptr<CachePolicy> policy;
+    size_t bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  // a pinned page and its version. Readers load page before version, a free
+  // slot is filled by storing version before page
+  struct PinnedSlot {
+    atomic<BasePage *> page{nullptr};
+    atomic<uint64_t> version{0};
+    size_t bytes = 0;  // changed under pinned_mutex_
+  };
+  // the slots of the 256 pids below one parent page
+  using PinnedChunk = array<PinnedSlot, 256>;
+  using PinnedLevel = unique_ptr<atomic<PinnedChunk *>[]>;
+
+  Shard &ShardOf(const PackedPageKey &key);
+  bool Pinnable(const PackedPageKey &key) const;
+  // nullptr when the chunk of key was never allocated and create is false.
+  // create requires pinned_mutex_
+  PinnedSlot *PinnedSlotOf(const PackedPageKey &key, bool create);
+  // stores page in the slot and measures it. A different page the slot held
+  // moves to the shards, or is retired when it has the version of key.
+  // Requires pinned_mutex_
+  void Pin(PinnedSlot *slot, const PackedPageKey &key, BasePage *page);
+  // removes and returns the page of key from its shard, nullptr if absent
+  BasePage *Take(const PackedPageKey &key);
+  void AddToShard(const PackedPageKey &key, BasePage *page);
+  // the shard must be locked and must not hold key
+  void Add(Shard &shard, const PackedPageKey &key, BasePage *page);
+  void Remove(Shard &shard, CacheEntry *entry);  // retires the page
+  void Measure(Shard &shard, CacheEntry *entry);
+  // a page evicted for the second tier, retired but not compressed yet
+  using Victim = pair<PackedPageKey, BasePage *>;
+  // evicts until the shard fits its budget, the last page is always kept.
+  // With a second tier the evicted pages are added to victims, which the
+  // caller passes to Spill once the shard lock is released
+  void Evict(Shard &shard, vector<Victim> &victims);
+  // compresses the victims into the second tier, takes no shard lock
+  void Spill(const vector<Victim> &victims);
+  void Retire(BasePage *page);
+
+  size_t max_bytes_;
+  size_t shard_bytes_;  // budget of one shard
+  size_t shard_mask_;  // the number of shards is a power of two
+  unique_ptr<Shard[]> shards_;
+  mutex retired_mutex_;
+  vector<BasePage *> retired_;
+  atomic<size_t> retired_count_;
+  vector<PinnedLevel> pinned_levels_;  // indexed by pid size / 2
+  mutex pinned_mutex_;
+  atomic<size_t> pinned_count_;
+  atomic<size_t> pinned_bytes_;
+  CompressedCache *second_tier_;  // not owned, nullptr when disabled
+};
+
+#endif
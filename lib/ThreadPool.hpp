@@ -0,0 +1,127 @@
+#ifndef _THREADPOOL_HPP_
+#define _THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed-size worker pool that runs one data-parallel loop at a time. The
+// calling thread takes part in the loop, so a pool of size n uses n - 1
+// background workers.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads)
+      : job_(nullptr),
+        job_size_(0),
+        next_index_(0),
+        pending_workers_(0),
+        generation_(0),
+        stop_(false) {
+    for (size_t i = 1; i < num_threads; i++) {
+      workers_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t Size() const { return workers_.size() + 1; }
+
+  // run fn(i) for every i in [0, n) and return after all of them finished,
+  // which makes every call a barrier. The first exception thrown by fn is
+  // rethrown here.
+  void ParallelFor(size_t n, const std::function<void(size_t)> &fn) {
+    if (n == 0) return;
+    if (workers_.empty() || n == 1) {
+      for (size_t i = 0; i < n; i++) fn(i);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = &fn;
+      job_size_ = n;
+      next_index_.store(0);
+      pending_workers_ = workers_.size();
+      error_ = nullptr;
+      generation_++;
+    }
+    start_cv_.notify_all();
+    RunJob(fn, n);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_workers_ == 0; });
+    job_ = nullptr;
+    if (error_) {
+      std::exception_ptr error = error_;
+      error_ = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  void RunJob(const std::function<void(size_t)> &fn, size_t n) {
+    size_t i;
+    while ((i = next_index_.fetch_add(1)) < n) {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) error_ = std::current_exception();
+        next_index_.store(n);  // skip the remaining work
+      }
+    }
+  }
+
+  void WorkerLoop() {
+    uint64_t seen_generation = 0;
+    while (true) {
+      const std::function<void(size_t)> *job;
+      size_t n;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_cv_.wait(lock, [&] {
+          return stop_ || generation_ != seen_generation;
+        });
+        if (stop_) return;
+        seen_generation = generation_;
+        job = job_;
+        n = job_size_;
+      }
+      RunJob(*job, n);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_workers_ == 0) done_cv_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(size_t)> *job_;
+  size_t job_size_;
+  std::atomic<size_t> next_index_;
+  size_t pending_workers_;
+  uint64_t generation_;
+  std::exception_ptr error_;
+  bool stop_;
+};
+
+#endif
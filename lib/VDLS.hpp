@@ -6,14 +6,22 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
+#include "common.hpp"
+
 using namespace std;
 
 // log stream format: fileID,offset,size\n
@@ -33,49 +41,88 @@ class VDLS {
         current_offset_(0),
         file_path_(file_path),
         write_map_(MAP_FAILED),
-        read_map_(MAP_FAILED),
-        read_map_fileID_(-1) {
+        read_map_chunks_(new atomic<atomic<void*>*>[ReadMapChunks]) {
+    for (size_t i = 0; i < ReadMapChunks; i++) {
+      read_map_chunks_[i].store(nullptr, memory_order_relaxed);
+    }
     OpenAndMapWriteFile();
   }
 
-  tuple<uint64_t, uint64_t, uint64_t> WriteValue(uint64_t version,
-                                                 const string& key,
-                                                 const string& value) {
-    string record = to_string(version) + "," + key + "," + value + "\n";
-    size_t record_size = record.size();
-
-    // 检查是否需要创建新文件
-    if (current_offset_ + record_size > MaxFileSize) {
-      // 同步更改到磁盘
-      if (msync(write_map_, MaxFileSize, MS_SYNC) == -1) {
-        throw runtime_error("Failed to sync changes to disk");
+  ~VDLS() {
+    for (size_t i = 0; i < ReadMapChunks; i++) {
+      atomic<void*>* chunk = read_map_chunks_[i].load(memory_order_relaxed);
+      if (chunk == nullptr) {
+        continue;
       }
-      // 解除旧的映射
-      if (write_map_ != MAP_FAILED) {
-        munmap(write_map_, MaxFileSize);
+      for (size_t j = 0; j < ReadMapChunkSize; j++) {
+        void* read_map = chunk[j].load(memory_order_relaxed);
+        if (read_map != MAP_FAILED) {
+          munmap(read_map, MaxFileSize);
+        }
       }
-
-      // 创建新文件 ID 和重置偏移量
-      current_fileID_++;
-      current_offset_ = 0;
-
-      // 重新打开和映射新文件
-      OpenAndMapWriteFile();
+      delete[] chunk;
+    }
+    if (write_map_ != MAP_FAILED) {
+      munmap(write_map_, MaxFileSize);
     }
+  }
 
-    // 写入新记录到写映射区域
-    memcpy(static_cast<char*>(write_map_) + current_offset_, record.c_str(),
-           record_size);
+  tuple<uint64_t, uint64_t, uint64_t> WriteValue(uint64_t version,
+                                                 string_view key,
+                                                 string_view value) {
+    tuple<uint64_t, uint64_t, uint64_t> location;
+    KeyValueRef kv{key, value};
+    WriteValues(version, &kv, 1, &location);
+    return location;
+  }
 
+  // append the records of one commit in a single pass, locations[i] receives
+  // the location of kvs[i]. The batch is sized up front, so the data file is
+  // only checked for a rollover per record when the batch does not fit
+  void WriteValues(uint64_t version, const KeyValueRef* kvs, size_t count,
+                   tuple<uint64_t, uint64_t, uint64_t>* locations) {
+    char version_str[24];
+    size_t version_size = snprintf(version_str, sizeof(version_str), "%lu",
+                                   static_cast<unsigned long>(version));
+    size_t total_size = 0;
+    for (size_t i = 0; i < count; i++) {
+      total_size += version_size + kvs[i].key.size() + kvs[i].value.size() + 3;
+    }
+    bool fits = current_offset_ + total_size <= MaxFileSize;
+
+    for (size_t i = 0; i < count; i++) {
+      size_t record_size =
+          version_size + kvs[i].key.size() + kvs[i].value.size() + 3;
+      // 检查是否需要创建新文件
+      if (!fits && current_offset_ + record_size > MaxFileSize) {
+        RollOverWriteFile();
+      }
+      // 写入新记录到写映射区域: version,key,value\n
+      char* dst = static_cast<char*>(write_map_) + current_offset_;
+      memcpy(dst, version_str, version_size);
+      dst += version_size;
+      *dst++ = ',';
+      memcpy(dst, kvs[i].key.data(), kvs[i].key.size());
+      dst += kvs[i].key.size();
+      *dst++ = ',';
+      memcpy(dst, kvs[i].value.data(), kvs[i].value.size());
+      dst += kvs[i].value.size();
+      *dst = '\n';
+
+      locations[i] = make_tuple(current_fileID_, current_offset_, record_size);
+      current_offset_ += record_size;
+    }
     // 同步更改到磁盘
     // if (msync(write_map_, MaxFileSize, MS_SYNC) == -1) {
     //   throw runtime_error("Failed to sync changes to disk");
     // }
+  }
 
-    current_offset_ += record_size;
-
-    return make_tuple(current_fileID_, current_offset_ - record_size,
-                      record_size);
+  vector<tuple<uint64_t, uint64_t, uint64_t>> WriteValues(
+      uint64_t version, const vector<KeyValueRef>& kvs) {
+    vector<tuple<uint64_t, uint64_t, uint64_t>> locations(kvs.size());
+    WriteValues(version, kvs.data(), kvs.size(), locations.data());
+    return locations;
   }
 
   tuple<uint64_t, uint64_t, uint64_t> WriteValueV1(
@@ -107,66 +154,33 @@ class VDLS {
     return location;
   }
 
-  // vector<tuple<uint64_t, uint64_t, uint64_t>> WriteValues(
-  //     uint64_t version, const vector<string>& key,
-  //     const vector<string>& value) {  // append a new record to the log
-  //     stream
-  //   string version_str = to_string(version);
-  //   size_t record_size =
-  //       version_str.size() + key[0].size() + value[0].size() + 3;
-  //   if (current_offset_ + record_size * key.size() > MaxFileSize) {
-  //     current_fileID_++;
-  //     current_offset_ = 0;
-  //   }
-
-  //   ofstream file(
-  //       file_path_ + "data_file_" + to_string(current_fileID_) + ".dat",
-  //       ios::app);  // create or open the file for appending
-  //   if (!file) {
-  //     throw std::runtime_error("Cannot open file ");
-  //   }
-
-  //   string content = "";
-  //   vector<tuple<uint64_t, uint64_t, uint64_t>> locations;
-  //   for (int i = 0; i < key.size(); i++) {
-  //     content += version_str + "," + key[i] + "," + value[i] + "\n";
-  //     current_offset_ += record_size;
-  //     locations.push_back(
-  //         make_tuple(current_fileID_, current_offset_, record_size));
-  //   }
-
-  //   file << content;
-
-  //   file.close();
-
-  //   return locations;
-  // }
-
-  string ReadValue(const tuple<uint64_t, uint64_t, uint64_t>& location) {
+  // the value of the record at location as a view into the mapped data file.
+  // A data file stays mapped once it is read, so the view is valid as long as
+  // this VDLS. Safe to call from many threads while one thread writes
+  string_view ReadValueView(
+      const tuple<uint64_t, uint64_t, uint64_t>& location) {
     uint64_t fileID, offset, size;
     tie(fileID, offset, size) = location;
-
-    // 检查是否需要重新映射文件
-    if (fileID != read_map_fileID_) {
-      if (read_map_ != MAP_FAILED) {
-        munmap(read_map_, MaxFileSize);
-        read_map_ = MAP_FAILED;
-      }
-      OpenAndMapReadFile(fileID);
-      read_map_fileID_ = fileID;
+    if (size == 0) {
+      return string_view();
     }
+    const char* record = static_cast<const char*>(ReadMap(fileID)) + offset;
+    // record: version,key,value\n. Versions and keys hold no ',', so the
+    // value starts after the second one
+    const char* end = record + size - 1;
+    const char* comma =
+        static_cast<const char*>(memchr(record, ',', end - record));
+    if (comma != nullptr) {
+      comma = static_cast<const char*>(memchr(comma + 1, ',', end - comma - 1));
+    }
+    if (comma == nullptr) {
+      return string_view();
+    }
+    return string_view(comma + 1, end - comma - 1);
+  }
 
-    // 从映射区域读取数据
-    string line(static_cast<char*>(read_map_) + offset, size);
-
-    stringstream ss(line);
-    string temp, value;
-
-    getline(ss, temp, ',');  // 版本号
-    getline(ss, temp, ',');  // 键
-    getline(ss, value);      // 值
-
-    return value;
+  string ReadValue(const tuple<uint64_t, uint64_t, uint64_t>& location) {
+    return string(ReadValueView(location));
   }
 
   string ReadValueV1(const tuple<uint64_t, uint64_t, uint64_t>& location) {
@@ -249,8 +263,69 @@ class VDLS {
   // const uint64_t MaxBufferSize = 12 * 1024 * 1024;  // 12MB
   // uint64_t BufferSize;
   void* write_map_;
-  void* read_map_;
-  int64_t read_map_fileID_;
+  // by fileID in chunks allocated on first use, MAP_FAILED when not mapped
+  // yet. Neither a chunk nor a map is ever replaced, so readers load them
+  // without locking
+  static constexpr uint64_t ReadMapChunkSize = 1 << 12;
+  static constexpr uint64_t ReadMapChunks = 1 << 14;  // 4PB of data files
+  static constexpr uint64_t MaxFiles = ReadMapChunkSize * ReadMapChunks;
+  unique_ptr<atomic<atomic<void*>*>[]> read_map_chunks_;
+  mutex read_map_mutex_;  // serializes mapping new files
+
+  void* ReadMap(uint64_t fileID) {
+    if (fileID >= MaxFiles) {
+      throw runtime_error("fileID out of range: " + to_string(fileID));
+    }
+    atomic<atomic<void*>*>& chunk_ref =
+        read_map_chunks_[fileID / ReadMapChunkSize];
+    atomic<void*>* chunk = chunk_ref.load(memory_order_acquire);
+    if (chunk != nullptr) {
+      void* read_map =
+          chunk[fileID % ReadMapChunkSize].load(memory_order_acquire);
+      if (read_map != MAP_FAILED) {
+        return read_map;
+      }
+    }
+    lock_guard<mutex> lock(read_map_mutex_);
+    chunk = chunk_ref.load(memory_order_relaxed);
+    if (chunk == nullptr) {
+      chunk = new atomic<void*>[ReadMapChunkSize];
+      for (size_t i = 0; i < ReadMapChunkSize; i++) {
+        chunk[i].store(MAP_FAILED, memory_order_relaxed);
+      }
+      chunk_ref.store(chunk, memory_order_release);
+    }
+    atomic<void*>& slot = chunk[fileID % ReadMapChunkSize];
+    void* read_map = slot.load(memory_order_relaxed);
+    if (read_map == MAP_FAILED) {
+      read_map = OpenAndMapReadFile(fileID);
+      slot.store(read_map, memory_order_release);
+    }
+    return read_map;
+  }
+
+  void RollOverWriteFile() {
+    // refuse to write a file ReadMap could not read back
+    if (current_fileID_ + 1 >= MaxFiles) {
+      throw runtime_error("value log is full: " + to_string(MaxFiles) +
+                          " data files");
+    }
+    // 同步更改到磁盘
+    if (msync(write_map_, MaxFileSize, MS_SYNC) == -1) {
+      throw runtime_error("Failed to sync changes to disk");
+    }
+    // 解除旧的映射
+    if (write_map_ != MAP_FAILED) {
+      munmap(write_map_, MaxFileSize);
+    }
+
+    // 创建新文件 ID 和重置偏移量
+    current_fileID_++;
+    current_offset_ = 0;
+
+    // 重新打开和映射新文件
+    OpenAndMapWriteFile();
+  }
 
   void OpenAndMapWriteFile() {
     string filename =
@@ -277,7 +352,7 @@ class VDLS {
     close(fd);
   }
 
-  void OpenAndMapReadFile(uint64_t fileID) {
+  void* OpenAndMapReadFile(uint64_t fileID) {
     string filename = file_path_ + "data_file_" + to_string(fileID) + ".dat";
 
     // 打开文件
@@ -293,17 +368,19 @@ class VDLS {
     //     throw runtime_error("Cannot get file size: " + filename);
     // }
     // // 内存映射文件为读映射区域，根据实际文件大小映射
-    // read_map_ = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // read_map = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
 
     // 直接映射MaxFileSize文件大小
-    read_map_ = mmap(nullptr, MaxFileSize, PROT_READ, MAP_SHARED, fd, 0);
-    if (read_map_ == MAP_FAILED) {
+    void* read_map =
+        mmap(nullptr, MaxFileSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (read_map == MAP_FAILED) {
       close(fd);
       throw runtime_error("Memory map for reading failed: " + filename);
     }
 
     // 关闭文件描述符，因为已经映射了文件
     close(fd);
+    return read_map;
   }
 };
 
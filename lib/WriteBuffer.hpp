@@ -0,0 +1,93 @@
+#ifndef _WRITEBUFFER_HPP_
+#define _WRITEBUFFER_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+
+using namespace std;
+
+// buffers the puts and deletes of one version until CalcRootHash. Keys and
+// values are copied into an arena once; Seal() sorts them and derives the
+// per-page work list of the commit as views into the arena, so building the
+// work list does not allocate per key.
+class WriteBuffer {
+ public:
+  struct Entry {
+    string_view key;
+    string_view value;  // empty for deletes
+    uint64_t seq;       // order of the write within the version
+  };
+
+  // one (pid, nibbles) pair to apply to a page. path = pid + nibbles is a
+  // prefix of the written key: the whole key for leaf updates (nibbles.size()
+  // < 2), the pid of the child page for index updates (nibbles.size() == 2)
+  struct NibbleGroup {
+    string_view path;
+    uint32_t pid_size;
+    const Entry *entry;  // the written key, only meaningful for leaf updates
+
+    string_view pid() const { return path.substr(0, pid_size); }
+    string_view nibbles() const { return path.substr(pid_size); }
+    bool IsLeaf() const { return path.size() - pid_size < 2; }
+  };
+
+  // the groups of one page, in the same order a set<string> of nibbles had
+  struct PageWork {
+    string_view pid;
+    const NibbleGroup *groups;
+    size_t group_count;
+  };
+
+  explicit WriteBuffer(size_t block_size = kDefaultBlockSize);
+
+  void Put(string_view key, string_view value);
+  void Delete(string_view key);
+  // bulk versions of Put and Delete. PutBatch/DeleteBatch copy into the
+  // arena, Adopt* take ownership of the strings without copying them, and
+  // Borrow* only keep views, so the caller's memory must outlive Clear()
+  void PutBatch(const KeyValueRef *kvs, size_t count);
+  void DeleteBatch(const string_view *keys, size_t count);
+  void AdoptPuts(vector<pair<string, string>> &&kvs);
+  void AdoptDeletes(vector<string> &&keys);
+  void BorrowPuts(const KeyValueRef *kvs, size_t count);
+  void BorrowDeletes(const string_view *keys, size_t count);
+  // keeps the last write of every key and builds the work list, ordered by
+  // pid length descending (children before parents), then pid, then nibbles
+  const vector<PageWork> &Seal();
+  // forgets all writes but keeps the arena blocks for the next version
+  void Clear();
+
+  bool Empty() const;
+  size_t Size() const;  // number of distinct keys after Seal()
+  const vector<Entry> &Entries() const;
+  size_t ArenaBytes() const;
+
+  static constexpr size_t kDefaultBlockSize = 1 << 20;  // 1MB
+
+ private:
+  string_view Append(string_view data);
+  void BeginWrite(size_t count);
+
+  size_t block_size_;
+  vector<unique_ptr<char[]>> blocks_;  // reused across versions
+  size_t block_index_;                 // block currently written to
+  size_t block_offset_;
+  vector<unique_ptr<char[]>> large_blocks_;  // items bigger than a block
+  size_t large_bytes_;
+  // adopted batches, moved as a whole so the strings never move
+  vector<vector<pair<string, string>>> adopted_puts_;
+  vector<vector<string>> adopted_deletes_;
+  vector<Entry> entries_;
+  vector<NibbleGroup> groups_;
+  vector<PageWork> pages_;
+  uint64_t next_seq_;
+  bool sealed_;
+};
+
+#endif
@@ -1,11 +1,19 @@
 #ifndef _COMMON_H_
 #define _COMMON_H_
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <string>
+#include <string_view>
 
 static constexpr int PAGE_SIZE = 12288;  //  包含页面大小(size_t)和数据(12KB),
 
+// a key-value pair borrowed from the caller
+struct KeyValueRef {
+  std::string_view key;
+  std::string_view value;
+};
+
 // PageKey结构体
 struct PageKey {
   uint64_t version;
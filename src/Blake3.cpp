@@ -0,0 +1,156 @@
+#include "Blake3.hpp"
+
+#include <cstring>
+
+// straight port of the BLAKE3 reference implementation: 1 KiB chunks of
+// 64-byte blocks, chunk chaining values merged into a binary tree through a
+// stack of subtree roots
+
+static const uint32_t kIV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372,
+                                0xA54FF53A, 0x510E527F, 0x9B05688C,
+                                0x1F83D9AB, 0x5BE0CD19};
+static const size_t kMsgPermutation[16] = {2, 6,  3,  10, 7,  0,  4,  13,
+                                           1, 11, 12, 5,  9,  14, 15, 8};
+static constexpr size_t kBlockLen = 64;
+static constexpr size_t kChunkLen = 1024;
+static constexpr uint32_t kChunkStart = 1 << 0;
+static constexpr uint32_t kChunkEnd = 1 << 1;
+static constexpr uint32_t kParent = 1 << 2;
+static constexpr uint32_t kRoot = 1 << 3;
+
+static inline uint32_t Rotr(uint32_t x, int bits) {
+  return (x >> bits) | (x << (32 - bits));
+}
+
+static inline void G(uint32_t *state, size_t a, size_t b, size_t c, size_t d,
+                     uint32_t mx, uint32_t my) {
+  state[a] = state[a] + state[b] + mx;
+  state[d] = Rotr(state[d] ^ state[a], 16);
+  state[c] = state[c] + state[d];
+  state[b] = Rotr(state[b] ^ state[c], 12);
+  state[a] = state[a] + state[b] + my;
+  state[d] = Rotr(state[d] ^ state[a], 8);
+  state[c] = state[c] + state[d];
+  state[b] = Rotr(state[b] ^ state[c], 7);
+}
+
+static void Compress(const uint32_t cv[8], const uint32_t block_words[16],
+                     uint64_t counter, uint32_t block_len, uint32_t flags,
+                     uint32_t out[8]) {
+  uint32_t state[16] = {cv[0],  cv[1],  cv[2],  cv[3],
+                        cv[4],  cv[5],  cv[6],  cv[7],
+                        kIV[0], kIV[1], kIV[2], kIV[3],
+                        uint32_t(counter), uint32_t(counter >> 32), block_len,
+                        flags};
+  uint32_t m[16];
+  memcpy(m, block_words, sizeof(m));
+  for (int round = 0; round < 7; round++) {
+    G(state, 0, 4, 8, 12, m[0], m[1]);
+    G(state, 1, 5, 9, 13, m[2], m[3]);
+    G(state, 2, 6, 10, 14, m[4], m[5]);
+    G(state, 3, 7, 11, 15, m[6], m[7]);
+    G(state, 0, 5, 10, 15, m[8], m[9]);
+    G(state, 1, 6, 11, 12, m[10], m[11]);
+    G(state, 2, 7, 8, 13, m[12], m[13]);
+    G(state, 3, 4, 9, 14, m[14], m[15]);
+    uint32_t permuted[16];
+    for (int i = 0; i < 16; i++) permuted[i] = m[kMsgPermutation[i]];
+    memcpy(m, permuted, sizeof(m));
+  }
+  for (int i = 0; i < 8; i++) out[i] = state[i] ^ state[i + 8];
+}
+
+static void LoadWords(const unsigned char *block, size_t len,
+                      uint32_t words[16]) {
+  unsigned char padded[kBlockLen] = {};
+  memcpy(padded, block, len);
+  for (int i = 0; i < 16; i++) {
+    words[i] = uint32_t(padded[4 * i]) | uint32_t(padded[4 * i + 1]) << 8 |
+               uint32_t(padded[4 * i + 2]) << 16 |
+               uint32_t(padded[4 * i + 3]) << 24;
+  }
+}
+
+// the last compression of a node, kept until we know whether it is the root
+struct Output {
+  uint32_t cv[8];
+  uint32_t block_words[16];
+  uint64_t counter;
+  uint32_t block_len;
+  uint32_t flags;
+
+  void ChainingValue(uint32_t out[8]) const {
+    Compress(cv, block_words, counter, block_len, flags, out);
+  }
+};
+
+// compress every block of a chunk except the last one
+static Output ChunkOutput(const unsigned char *chunk, size_t len,
+                          uint64_t chunk_counter) {
+  Output output;
+  memcpy(output.cv, kIV, sizeof(kIV));
+  uint32_t start_flag = kChunkStart;
+  while (len > kBlockLen) {
+    uint32_t words[16];
+    LoadWords(chunk, kBlockLen, words);
+    Compress(output.cv, words, chunk_counter, kBlockLen, start_flag,
+             output.cv);
+    start_flag = 0;
+    chunk += kBlockLen;
+    len -= kBlockLen;
+  }
+  LoadWords(chunk, len, output.block_words);
+  output.counter = chunk_counter;
+  output.block_len = uint32_t(len);
+  output.flags = start_flag | kChunkEnd;
+  return output;
+}
+
+static Output ParentOutput(const uint32_t left[8], const uint32_t right[8]) {
+  Output output;
+  memcpy(output.cv, kIV, sizeof(kIV));
+  memcpy(output.block_words, left, 8 * sizeof(uint32_t));
+  memcpy(output.block_words + 8, right, 8 * sizeof(uint32_t));
+  output.counter = 0;
+  output.block_len = kBlockLen;
+  output.flags = kParent;
+  return output;
+}
+
+void Blake3Hash(const char *data, size_t size, unsigned char *out) {
+  const unsigned char *input = reinterpret_cast<const unsigned char *>(data);
+  uint32_t cv_stack[54][8];  // enough for 2^54 chunks
+  size_t cv_stack_len = 0;
+  uint64_t chunk_counter = 0;
+
+  // every chunk but the last is merged into the stack right away
+  while (size > kChunkLen) {
+    uint32_t cv[8];
+    ChunkOutput(input, kChunkLen, chunk_counter).ChainingValue(cv);
+    input += kChunkLen;
+    size -= kChunkLen;
+    uint64_t total_chunks = ++chunk_counter;
+    while ((total_chunks & 1) == 0) {
+      ParentOutput(cv_stack[--cv_stack_len], cv).ChainingValue(cv);
+      total_chunks >>= 1;
+    }
+    memcpy(cv_stack[cv_stack_len++], cv, sizeof(cv));
+  }
+
+  Output output = ChunkOutput(input, size, chunk_counter);
+  while (cv_stack_len > 0) {
+    uint32_t cv[8];
+    output.ChainingValue(cv);
+    output = ParentOutput(cv_stack[--cv_stack_len], cv);
+  }
+
+  uint32_t words[8];
+  Compress(output.cv, output.block_words, 0, output.block_len,
+           output.flags | kRoot, words);
+  for (int i = 0; i < 8; i++) {
+    out[4 * i] = uint8_t(words[i]);
+    out[4 * i + 1] = uint8_t(words[i] >> 8);
+    out[4 * i + 2] = uint8_t(words[i] >> 16);
+    out[4 * i + 3] = uint8_t(words[i] >> 24);
+  }
+}
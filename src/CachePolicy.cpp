@@ -0,0 +1,269 @@
+#include "CachePolicy.hpp"
+
+#include <algorithm>
+
+void EntryQueue::PushFront(CacheEntry *entry) {
+  entry->prev = nullptr;
+  entry->next = head_;
+  if (head_ != nullptr) {
+    head_->prev = entry;
+  } else {
+    tail_ = entry;
+  }
+  head_ = entry;
+  bytes_ += entry->bytes;
+}
+
+void EntryQueue::Remove(CacheEntry *entry) {
+  if (entry->prev != nullptr) {
+    entry->prev->next = entry->next;
+  } else {
+    head_ = entry->next;
+  }
+  if (entry->next != nullptr) {
+    entry->next->prev = entry->prev;
+  } else {
+    tail_ = entry->prev;
+  }
+  entry->prev = entry->next = nullptr;
+  bytes_ -= entry->bytes;
+}
+
+void GhostQueue::Push(const PackedPageKey &key, size_t bytes) {
+  Erase(key);
+  keys_.emplace_front(key, bytes);
+  index_[key] = keys_.begin();
+  bytes_ += bytes;
+}
+
+bool GhostQueue::Erase(const PackedPageKey &key) {
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return false;
+  }
+  bytes_ -= it->second->second;
+  keys_.erase(it->second);
+  index_.erase(it);
+  return true;
+}
+
+void GhostQueue::PopBack() {
+  bytes_ -= keys_.back().second;
+  index_.erase(keys_.back().first);
+  keys_.pop_back();
+}
+
+const char *CachePolicyName(CachePolicyType type) {
+  switch (type) {
+    case CachePolicyType::kCLOCK:
+      return "clock";
+    case CachePolicyType::kLRU:
+      return "lru";
+    case CachePolicyType::k2Q:
+      return "2q";
+    case CachePolicyType::kARC:
+      return "arc";
+  }
+  return "unknown";
+}
+
+unique_ptr<CachePolicy> NewCachePolicy(CachePolicyType type,
+                                       size_t capacity) {
+  switch (type) {
+    case CachePolicyType::kLRU:
+      return make_unique<LRUPolicy>();
+    case CachePolicyType::k2Q:
+      return make_unique<TwoQueuePolicy>(capacity);
+    case CachePolicyType::kARC:
+      return make_unique<ARCPolicy>(capacity);
+    default:
+      return make_unique<ClockPolicy>();
+  }
+}
+
+// a new page goes right behind the hand, the last place it looks at
+void ClockPolicy::Insert(CacheEntry *entry) {
+  entry->queue = 0;  // the reference bit
+  if (hand_ == nullptr) {
+    entry->prev = entry->next = entry;
+    hand_ = entry;
+    return;
+  }
+  entry->next = hand_;
+  entry->prev = hand_->prev;
+  hand_->prev->next = entry;
+  hand_->prev = entry;
+}
+
+void ClockPolicy::Access(CacheEntry *entry) { entry->queue = 1; }
+
+void ClockPolicy::Remove(CacheEntry *entry) {
+  if (entry->next == entry) {
+    hand_ = nullptr;
+  } else {
+    if (hand_ == entry) {
+      hand_ = entry->next;
+    }
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+  }
+  entry->prev = entry->next = nullptr;
+}
+
+void ClockPolicy::Resize(CacheEntry *, size_t) {}
+
+CacheEntry *ClockPolicy::Evict() {
+  if (hand_ == nullptr) {
+    return nullptr;
+  }
+  while (hand_->queue != 0) {  // ends after one round at the latest
+    hand_->queue = 0;
+    hand_ = hand_->next;
+  }
+  CacheEntry *victim = hand_;
+  Remove(victim);
+  return victim;
+}
+
+void LRUPolicy::Insert(CacheEntry *entry) { pages_.PushFront(entry); }
+
+void LRUPolicy::Access(CacheEntry *entry) {
+  pages_.Remove(entry);
+  pages_.PushFront(entry);
+}
+
+void LRUPolicy::Remove(CacheEntry *entry) { pages_.Remove(entry); }
+
+void LRUPolicy::Resize(CacheEntry *entry, size_t old_bytes) {
+  pages_.Resize(old_bytes, entry->bytes);
+}
+
+CacheEntry *LRUPolicy::Evict() {
+  CacheEntry *victim = pages_.Back();
+  if (victim != nullptr) {
+    pages_.Remove(victim);
+  }
+  return victim;
+}
+
+// the sizes recommended by the 2Q paper: a quarter of the budget for pages
+// seen once and ghosts for half of it
+TwoQueuePolicy::TwoQueuePolicy(size_t capacity)
+    : in_bytes_(capacity / 4), out_bytes_(capacity / 2) {}
+
+EntryQueue &TwoQueuePolicy::QueueOf(CacheEntry *entry) {
+  return entry->queue == kMain ? main_ : in_;
+}
+
+void TwoQueuePolicy::Insert(CacheEntry *entry) {
+  // a page evicted from in_ not long ago is seen the second time
+  entry->queue = out_.Erase(entry->key) ? kMain : kIn;
+  QueueOf(entry).PushFront(entry);
+}
+
+void TwoQueuePolicy::Access(CacheEntry *entry) {
+  // hits in in_ are correlated references of the first use, pages only
+  // move to main_ after being seen again once evicted
+  if (entry->queue == kMain) {
+    main_.Remove(entry);
+    main_.PushFront(entry);
+  }
+}
+
+void TwoQueuePolicy::Remove(CacheEntry *entry) {
+  QueueOf(entry).Remove(entry);
+}
+
+void TwoQueuePolicy::Resize(CacheEntry *entry, size_t old_bytes) {
+  QueueOf(entry).Resize(old_bytes, entry->bytes);
+}
+
+CacheEntry *TwoQueuePolicy::Evict() {
+  if (!in_.Empty() && (in_.Bytes() > in_bytes_ || main_.Empty())) {
+    CacheEntry *victim = in_.Back();
+    in_.Remove(victim);
+    out_.Push(victim->key, victim->bytes);
+    while (out_.Bytes() > out_bytes_) {
+      out_.PopBack();
+    }
+    return victim;
+  }
+  CacheEntry *victim = main_.Back();
+  if (victim != nullptr) {
+    main_.Remove(victim);
+  }
+  return victim;
+}
+
+ARCPolicy::ARCPolicy(size_t capacity) : capacity_(capacity), target_(0) {}
+
+EntryQueue &ARCPolicy::QueueOf(CacheEntry *entry) {
+  return entry->queue == kFrequent ? frequent_ : recent_;
+}
+
+void ARCPolicy::Insert(CacheEntry *entry) {
+  // a miss on a ghost means the queue it was evicted from was too short,
+  // the target moves towards it by the page size, scaled up when the other
+  // ghost queue is the larger one
+  size_t recent_ghosts = max<size_t>(1, recent_ghosts_.Bytes());
+  size_t frequent_ghosts = max<size_t>(1, frequent_ghosts_.Bytes());
+  if (recent_ghosts_.Erase(entry->key)) {
+    size_t delta =
+        entry->bytes * max<size_t>(1, frequent_ghosts / recent_ghosts);
+    target_ = min(capacity_, target_ + delta);
+    entry->queue = kFrequent;
+  } else if (frequent_ghosts_.Erase(entry->key)) {
+    size_t delta =
+        entry->bytes * max<size_t>(1, recent_ghosts / frequent_ghosts);
+    target_ = target_ > delta ? target_ - delta : 0;
+    entry->queue = kFrequent;
+  } else {
+    entry->queue = kRecent;
+  }
+  QueueOf(entry).PushFront(entry);
+  TrimGhosts();
+}
+
+void ARCPolicy::Access(CacheEntry *entry) {
+  QueueOf(entry).Remove(entry);
+  entry->queue = kFrequent;
+  frequent_.PushFront(entry);
+}
+
+void ARCPolicy::Remove(CacheEntry *entry) { QueueOf(entry).Remove(entry); }
+
+void ARCPolicy::Resize(CacheEntry *entry, size_t old_bytes) {
+  QueueOf(entry).Resize(old_bytes, entry->bytes);
+}
+
+CacheEntry *ARCPolicy::Evict() {
+  CacheEntry *victim;
+  if (!recent_.Empty() && (recent_.Bytes() > target_ || frequent_.Empty())) {
+    victim = recent_.Back();
+    recent_.Remove(victim);
+    recent_ghosts_.Push(victim->key, victim->bytes);
+  } else if (!frequent_.Empty()) {
+    victim = frequent_.Back();
+    frequent_.Remove(victim);
+    frequent_ghosts_.Push(victim->key, victim->bytes);
+  } else {
+    return nullptr;
+  }
+  TrimGhosts();
+  return victim;
+}
+
+// T1 and B1 together stay within the capacity, all four queues within
+// twice the capacity
+void ARCPolicy::TrimGhosts() {
+  while (!recent_ghosts_.Empty() &&
+         recent_.Bytes() + recent_ghosts_.Bytes() > capacity_) {
+    recent_ghosts_.PopBack();
+  }
+  while (!frequent_ghosts_.Empty() &&
+         recent_.Bytes() + frequent_.Bytes() + recent_ghosts_.Bytes() +
+                 frequent_ghosts_.Bytes() >
+             2 * capacity_) {
+    frequent_ghosts_.PopBack();
+  }
+}
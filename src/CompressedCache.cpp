@@ -0,0 +1,267 @@
+#include "CompressedCache.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#include "DMMTrie.hpp"
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;  // the block ends with literals
+constexpr size_t kMatchLimit = 12;   // no match starts in the last bytes
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashBits = 12;
+
+inline uint32_t Read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint32_t HashOf(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - kHashBits);
+}
+
+inline uint8_t *WriteLength(uint8_t *out, size_t length) {
+  for (; length >= 255; length -= 255) {
+    *out++ = 255;
+  }
+  *out++ = uint8_t(length);
+  return out;
+}
+
+// false when the length runs past end
+inline bool ReadLength(const uint8_t *&in, const uint8_t *end,
+                       size_t &length) {
+  uint8_t byte;
+  do {
+    if (in >= end) {
+      return false;
+    }
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+}  // namespace
+
+size_t LZ4CompressBound(size_t size) { return size + size / 255 + 16; }
+
+// greedy matching on a table of the last position of each hashed 4 bytes
+size_t LZ4Compress(const char *src, size_t size, char *dst) {
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(src);
+  const uint8_t *end = in + size;
+  uint8_t *out = reinterpret_cast<uint8_t *>(dst);
+  const uint8_t *anchor = in;  // first literal not written yet
+  if (size > kMatchLimit) {
+    unique_ptr<uint32_t[]> table(new uint32_t[1 << kHashBits]());
+    const uint8_t *ip = in;
+    while (ip + kMatchLimit <= end) {
+      uint32_t sequence = Read32(ip);
+      uint32_t &slot = table[HashOf(sequence)];
+      const uint8_t *ref = in + slot;
+      slot = uint32_t(ip - in);
+      if (ref >= ip || size_t(ip - ref) > kMaxOffset ||
+          Read32(ref) != sequence) {
+        ip++;
+        continue;
+      }
+      const uint8_t *match_end = ip + kMinMatch;
+      const uint8_t *ref_end = ref + kMinMatch;
+      while (match_end < end - kLastLiterals && *match_end == *ref_end) {
+        match_end++;
+        ref_end++;
+      }
+      size_t literals = ip - anchor;
+      size_t match = match_end - ip - kMinMatch;
+      uint8_t *token = out++;
+      *token = uint8_t((min<size_t>(literals, 15) << 4) |
+                       min<size_t>(match, 15));
+      if (literals >= 15) {
+        out = WriteLength(out, literals - 15);
+      }
+      memcpy(out, anchor, literals);
+      out += literals;
+      size_t offset = ip - ref;
+      *out++ = uint8_t(offset);
+      *out++ = uint8_t(offset >> 8);
+      if (match >= 15) {
+        out = WriteLength(out, match - 15);
+      }
+      ip = anchor = match_end;
+    }
+  }
+  size_t literals = end - anchor;
+  *out++ = uint8_t(min<size_t>(literals, 15) << 4);
+  if (literals >= 15) {
+    out = WriteLength(out, literals - 15);
+  }
+  memcpy(out, anchor, literals);
+  out += literals;
+  return out - reinterpret_cast<uint8_t *>(dst);
+}
+
+int64_t LZ4Decompress(const char *src, size_t size, char *dst,
+                      size_t capacity) {
+  const uint8_t *in = reinterpret_cast<const uint8_t *>(src);
+  const uint8_t *in_end = in + size;
+  uint8_t *out_begin = reinterpret_cast<uint8_t *>(dst);
+  uint8_t *out = out_begin;
+  uint8_t *out_end = out + capacity;
+  while (in < in_end) {
+    uint8_t token = *in++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !ReadLength(in, in_end, literals)) {
+      return -1;
+    }
+    if (literals > size_t(in_end - in) || literals > size_t(out_end - out)) {
+      return -1;
+    }
+    memcpy(out, in, literals);
+    in += literals;
+    out += literals;
+    if (in == in_end) {  // the last sequence has no match
+      break;
+    }
+    if (in_end - in < 2) {
+      return -1;
+    }
+    size_t offset = in[0] | size_t(in[1]) << 8;
+    in += 2;
+    size_t match = token & 15;
+    if (match == 15 && !ReadLength(in, in_end, match)) {
+      return -1;
+    }
+    match += kMinMatch;
+    if (offset == 0 || offset > size_t(out - out_begin) ||
+        match > size_t(out_end - out)) {
+      return -1;
+    }
+    const uint8_t *ref = out - offset;
+    if (offset >= match) {
+      memcpy(out, ref, match);
+      out += match;
+    } else {  // the match repeats its own output
+      for (size_t i = 0; i < match; i++) {
+        *out++ = *ref++;
+      }
+    }
+  }
+  return out - out_begin;
+}
+
+CompressedCache::CompressedCache(size_t max_bytes)
+    : max_bytes_(max_bytes), bytes_(0), raw_bytes_(0), hits_(0), misses_(0) {}
+
+// the list node and the index entry included
+size_t CompressedCache::BytesOf(const Blob &blob) {
+  return sizeof(Blob) + blob.data.capacity() + 4 * sizeof(void *) +
+         sizeof(PackedPageKey);
+}
+
+// serialized and compressed before taking the lock, evicting readers of
+// different shards only meet for the list update
+void CompressedCache::Put(const PackedPageKey &key, BasePage *page) {
+  if (page->GetRoot() == nullptr) {  // an empty page has no serialized form
+    return;
+  }
+  thread_local string raw(PAGE_SIZE, '\0');
+  thread_local string packed(LZ4CompressBound(PAGE_SIZE), '\0');
+  size_t raw_size = page->SerializeTo(&raw[0]);
+  // SerializeTo stores the version of the root node, the page is read back
+  // with the version of its page key
+  uint64_t version = page->GetPageKey().version;
+  memcpy(&raw[0], &version, sizeof(version));
+  size_t packed_size = LZ4Compress(raw.data(), raw_size, &packed[0]);
+  Blob blob{key, string(packed.data(), packed_size), raw_size};
+  size_t bytes = BytesOf(blob);
+  if (bytes > max_bytes_) {
+    return;
+  }
+  lock_guard<mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    Remove(it->second);
+  }
+  blobs_.push_front(std::move(blob));
+  index_[key] = blobs_.begin();
+  bytes_ += bytes;
+  raw_bytes_ += raw_size;
+  while (bytes_ > max_bytes_) {
+    Remove(prev(blobs_.end()));
+  }
+}
+
+bool CompressedCache::Take(const PackedPageKey &key, string &buffer) {
+  string data;
+  size_t raw_size;
+  {
+    lock_guard<mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      misses_++;
+      return false;
+    }
+    hits_++;
+    BlobList::iterator blob = it->second;
+    raw_size = blob->raw_size;
+    bytes_ -= BytesOf(*blob);
+    raw_bytes_ -= raw_size;
+    data = std::move(blob->data);
+    index_.erase(it);
+    blobs_.erase(blob);
+  }
+  buffer.resize(raw_size);
+  int64_t size = LZ4Decompress(data.data(), data.size(), &buffer[0],
+                               buffer.size());
+  if (size != int64_t(raw_size)) {
+    cerr << "corrupted compressed page, version " << key.version << endl;
+    return false;
+  }
+  return true;
+}
+
+void CompressedCache::Erase(const PackedPageKey &key) {
+  lock_guard<mutex> lock(mutex_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    Remove(it->second);
+  }
+}
+
+void CompressedCache::Remove(BlobList::iterator it) {
+  bytes_ -= BytesOf(*it);
+  raw_bytes_ -= it->raw_size;
+  index_.erase(it->key);
+  blobs_.erase(it);
+}
+
+size_t CompressedCache::Size() const {
+  lock_guard<mutex> lock(mutex_);
+  return blobs_.size();
+}
+
+size_t CompressedCache::MemoryUsage() const {
+  lock_guard<mutex> lock(mutex_);
+  return bytes_;
+}
+
+size_t CompressedCache::RawBytes() const {
+  lock_guard<mutex> lock(mutex_);
+  return raw_bytes_;
+}
+
+size_t CompressedCache::MaxBytes() const { return max_bytes_; }
+
+uint64_t CompressedCache::Hits() const {
+  lock_guard<mutex> lock(mutex_);
+  return hits_;
+}
+
+uint64_t CompressedCache::Misses() const {
+  lock_guard<mutex> lock(mutex_);
+  return misses_;
+}
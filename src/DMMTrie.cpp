@@ -1,8 +1,5 @@
 #include "DMMTrie.hpp"
 
-#include <openssl/evp.h>
-#include <openssl/sha.h>
-
 #include <algorithm>
 #include <array>
 #include <cstring>
@@ -12,6 +9,7 @@
 #include <memory>
 #include <set>
 #include <sstream>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
@@ -20,39 +18,43 @@
 
 using namespace std;
 
-// string HashFunction(const string &input) {  // hash function SHA-256
-//   EVP_MD_CTX *ctx = EVP_MD_CTX_new();       // create SHA-256 context
-
-//   // initialize SHA-256 hash computation
-//   EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
-
-//   // update the hash with input string
-//   EVP_DigestUpdate(ctx, input.c_str(), input.size());
-
-//   unsigned char hash[EVP_MAX_MD_SIZE];
-//   unsigned int hash_len = 0;
+// pages record the hash algorithm and digest width they were written with as
+// | hash_algorithm (1) | hash_size (1) |
+static constexpr size_t kHashFormatSize = 2 * sizeof(uint8_t);
 
-//   EVP_DigestFinal_ex(ctx, hash, &hash_len);
+// file of the key filter in the index directory of LSVPS
+static const char kKeyFilterFile[] = "/key_filter.dat";
 
-//   EVP_DigestFinal_ex(ctx, hash, &hash_len);
-//   EVP_MD_CTX_free(ctx);
-
-//   return string(reinterpret_cast<char *>(hash), hash_len);
-// }
+// heap bytes of a string, 0 when it is stored inline
+static size_t StringHeapBytes(const string &str) {
+  const char *data = str.data();
+  const char *object = reinterpret_cast<const char *>(&str);
+  if (data >= object && data < object + sizeof(str)) {
+    return 0;
+  }
+  return str.capacity() + 1;
+}
 
-string HashFunction(const string &input) {  // SHA 1
-  unsigned char hash[SHA_DIGEST_LENGTH];
-  SHA1(reinterpret_cast<const unsigned char *>(input.c_str()), input.size(),
-       hash);
-  return string(reinterpret_cast<char *>(hash), SHA_DIGEST_LENGTH);
+static void WriteHashFormat(char *buffer) {
+  buffer[0] = static_cast<char>(HashPolicy::kAlgorithm);
+  buffer[1] = static_cast<char>(HASH_SIZE);
 }
 
-auto CompareStrings = [](const std::string &a, const std::string &b) {
-  if (a.size() != b.size()) {
-    return a.size() > b.size();  // first compare length
+// refuse to load pages produced by a build using a different hash policy
+static void CheckHashFormat(const char *buffer) {
+  uint8_t algorithm = static_cast<uint8_t>(buffer[0]);
+  uint8_t hash_size = static_cast<uint8_t>(buffer[1]);
+  if (algorithm != static_cast<uint8_t>(HashPolicy::kAlgorithm) ||
+      hash_size != HASH_SIZE) {
+    throw runtime_error("page hash algorithm " + to_string(algorithm) + "/" +
+                        to_string(hash_size) + " does not match " +
+                        HashPolicy::kName + "/" + to_string(HASH_SIZE));
   }
-  return a < b;  // then compare alphabetical order
-};
+}
+
+// pages of one commit wave whose deltapages stay pinned, kept well below the
+// capacity of the active deltapage cache in LSVPS
+static constexpr size_t kMaxPagesPerWave = 1024;
 
 // convert hexadecimal digit to corresponding index 0~15
 int GetIndex(char ch) {
@@ -69,11 +71,11 @@ int GetIndex(char ch) {
 
 void Node::CalculateHash() {}
 void Node::AddChild(int index, Node *child, uint64_t version,
-                    const string &hash) {}
+                    const Digest &hash) {}
 Node *Node::GetChild(int index) const { return nullptr; }
 bool Node::HasChild(int index) const { return false; }
-void Node::SetChild(int index, uint64_t version, string hash) {}
-string Node::GetChildHash(int index) {}
+void Node::SetChild(int index, uint64_t version, const Digest &hash) {}
+Digest Node::GetChildHash(int index) { return Digest(); }
 uint64_t Node::GetChildVersion(int index) {}
 void Node::UpdateNode() {}
 void Node::SetLocation(tuple<uint64_t, uint64_t, uint64_t> location) {}
@@ -81,17 +83,17 @@ NodeProof Node::GetNodeProof(int level, int index) {}
 
 LeafNode::LeafNode(uint64_t V, const string &k,
                    const tuple<uint64_t, uint64_t, uint64_t> &l,
-                   const string &h)
+                   const Digest &h)
     : version_(V), key_(k), location_(l), hash_(h), is_leaf_(true) {}
 
 void LeafNode::CalculateHash(const string &value) {
   // hash_ = HashFunction(key_ + value);
-  hash_ = HashFunction(value);
+  hash_ = HashDigest(value.data(), value.size());
 }
 
 /* serialized leaf node format (size in bytes):
    | is_leaf_node (1) | version (8) | key_size (8 in 64-bit system) | key
-   (key_size) | location(8, 8, 8) | hash (32) |
+   (key_size) | location(8, 8, 8) | hash (HASH_SIZE) |
 */
 void LeafNode::SerializeTo(char *buffer, size_t &current_size,
                            bool is_root) const {
@@ -118,7 +120,7 @@ void LeafNode::SerializeTo(char *buffer, size_t &current_size,
          sizeof(uint64_t));  // size
   current_size += sizeof(uint64_t);
 
-  memcpy(buffer + current_size, hash_.c_str(), hash_.size());
+  memcpy(buffer + current_size, hash_.data(), HASH_SIZE);
   current_size += HASH_SIZE;
 }
 
@@ -145,22 +147,18 @@ void LeafNode::DeserializeFrom(char *buffer, size_t &current_size,
   current_size += sizeof(uint64_t);
   location_ = make_tuple(fileID, offset, size);
 
-  hash_ = string(buffer + current_size, HASH_SIZE);  // deserialize hash
+  memcpy(hash_.data(), buffer + current_size, HASH_SIZE);  // deserialize hash
   current_size += HASH_SIZE;
 }
 
 void LeafNode::UpdateNode(uint64_t version,
                           const tuple<uint64_t, uint64_t, uint64_t> &location,
-                          const string &value, uint8_t location_in_page,
+                          const Digest &value_hash, uint8_t location_in_page,
                           DeltaPage *deltapage) {
   version_ = version;
   location_ = location;
-  if (value == "") {  // value是空字符串代表Delete节点，此时将哈希改为空串
-    hash_ = "";
-  } else {
-    // hash_ = HashFunction(key_ + value);
-    hash_ = HashFunction(value);
-  }
+  // Delete节点的value是空字符串，其哈希为空digest
+  hash_ = value_hash;
 
   if (deltapage != nullptr) {
     deltapage->AddLeafNodeUpdate(location_in_page, version, hash_,
@@ -177,27 +175,32 @@ void LeafNode::SetLocation(tuple<uint64_t, uint64_t, uint64_t> location) {
   location_ = location;
 }
 
-string LeafNode::GetHash() { return hash_; }
+Digest LeafNode::GetHash() { return hash_; }
 uint64_t LeafNode::GetVersion() { return version_; }
 void LeafNode::SetVersion(uint64_t version) { version_ = version; }
-void LeafNode::SetHash(string hash) { hash_ = hash; }
+void LeafNode::SetHash(const Digest &hash) { hash_ = hash; }
 
 bool LeafNode::IsLeaf() const { return is_leaf_; }
 
-IndexNode::IndexNode(uint64_t V, const string &h, uint16_t b)
-    : version_(V), hash_(h), bitmap_(b), is_leaf_(false) {
+size_t LeafNode::MemoryUsage() const {
+  return sizeof(LeafNode) + StringHeapBytes(key_);
+}
+
+IndexNode::IndexNode(uint64_t V, const Digest &h, uint16_t b)
+    : version_(V), hash_(h), bitmap_(b), dirty_(0), is_leaf_(false) {
   for (size_t i = 0; i < DMM_NODE_FANOUT; i++) {
     children_[i] =
-        make_tuple(0, "", nullptr);  // initialize children to default
+        make_tuple(0, Digest(), nullptr);  // initialize children to default
   }
 }
 
 IndexNode::IndexNode(
-    uint64_t version, const string &hash, uint16_t bitmap,
-    const array<tuple<uint64_t, string, Node *>, DMM_NODE_FANOUT> &children)
+    uint64_t version, const Digest &hash, uint16_t bitmap,
+    const array<tuple<uint64_t, Digest, Node *>, DMM_NODE_FANOUT> &children)
     : version_(version),
       hash_(hash),
       bitmap_(bitmap),
+      dirty_(0),
       children_(children),
       is_leaf_(false) {}
 
@@ -205,6 +208,7 @@ IndexNode::IndexNode(const IndexNode &other)
     : version_(other.version_),
       hash_(other.hash_),
       bitmap_(other.bitmap_),
+      dirty_(other.dirty_),
       is_leaf_(other.is_leaf_) {
   // Deep copy children array
   for (size_t i = 0; i < DMM_NODE_FANOUT; i++) {
@@ -226,22 +230,34 @@ IndexNode::IndexNode(const IndexNode &other)
       }
 
     } else {
-      children_[i] = make_tuple(0, "", nullptr);
+      children_[i] = make_tuple(0, Digest(), nullptr);
     }
   }
 }
 
 void IndexNode::CalculateHash() {
-  string concatenated_hash;
+  char concatenated_hash[DMM_NODE_FANOUT * HASH_SIZE];
+  hash_ = HashDigest(concatenated_hash, ConcatChildHashes(concatenated_hash));
+}
+
+// concatenate the non-empty child digests in order into buffer, which must
+// hold DMM_NODE_FANOUT * HASH_SIZE bytes. Empty children contribute nothing,
+// as the empty string did before
+size_t IndexNode::ConcatChildHashes(char *buffer) const {
+  size_t size = 0;
   for (int i = 0; i < DMM_NODE_FANOUT; i++) {
-    concatenated_hash += get<1>(children_[i]);
+    const Digest &child_hash = get<1>(children_[i]);
+    if (!child_hash.IsEmpty()) {
+      memcpy(buffer + size, child_hash.data(), HASH_SIZE);
+      size += HASH_SIZE;
+    }
   }
-  hash_ = HashFunction(concatenated_hash);
+  return size;
 }
 
 /* serialized index node format (size in bytes):
-   | is_leaf_node (1) | version (8) | hash (32) | bitmap (2) | Vc (8) | Hc
-   (32) | Vc (8) | Hc (32) | ... | child 1 | child 2 | ...
+   | is_leaf_node (1) | version (8) | hash (HASH_SIZE) | bitmap (2) | Vc (8) |
+   Hc (HASH_SIZE) | Vc (8) | Hc (HASH_SIZE) | ... | child 1 | child 2 | ...
    the function doesn't serialize pointer and doesn't serialize empty child
    nodes
 */
@@ -254,7 +270,7 @@ void IndexNode::SerializeTo(char *buffer, size_t &current_size,
   memcpy(buffer + current_size, &version_, sizeof(uint64_t));
   current_size += sizeof(uint64_t);
 
-  memcpy(buffer + current_size, hash_.c_str(), hash_.size());
+  memcpy(buffer + current_size, hash_.data(), HASH_SIZE);
   current_size += HASH_SIZE;
 
   memcpy(buffer + current_size, &bitmap_, sizeof(uint16_t));
@@ -263,11 +279,11 @@ void IndexNode::SerializeTo(char *buffer, size_t &current_size,
   for (int i = 0; i < DMM_NODE_FANOUT; i++) {
     if (bitmap_ & (1 << i)) {
       uint64_t child_version = get<0>(children_[i]);
-      string child_hash = get<1>(children_[i]);
+      const Digest &child_hash = get<1>(children_[i]);
 
       memcpy(buffer + current_size, &child_version, sizeof(uint64_t));
       current_size += sizeof(uint64_t);
-      memcpy(buffer + current_size, child_hash.c_str(), child_hash.size());
+      memcpy(buffer + current_size, child_hash.data(), HASH_SIZE);
       current_size += HASH_SIZE;
     }
   }
@@ -288,7 +304,7 @@ void IndexNode::DeserializeFrom(char *buffer, size_t &current_size,
   version_ = *(reinterpret_cast<uint64_t *>(buffer + current_size));
   current_size += sizeof(uint64_t);
 
-  hash_ = string(buffer + current_size, HASH_SIZE);
+  memcpy(hash_.data(), buffer + current_size, HASH_SIZE);
   current_size += HASH_SIZE;
 
   bitmap_ = *(reinterpret_cast<uint16_t *>(buffer + current_size));
@@ -299,7 +315,8 @@ void IndexNode::DeserializeFrom(char *buffer, size_t &current_size,
       uint64_t child_version =
           *(reinterpret_cast<uint64_t *>(buffer + current_size));
       current_size += sizeof(uint64_t);
-      string child_hash(buffer + current_size, HASH_SIZE);
+      Digest child_hash;
+      memcpy(child_hash.data(), buffer + current_size, HASH_SIZE);
       current_size += HASH_SIZE;
 
       children_[i] = make_tuple(child_version, child_hash, nullptr);
@@ -320,37 +337,89 @@ void IndexNode::DeserializeFrom(char *buffer, size_t &current_size,
       if (child_is_leaf_node) {  // second level of page is leafnode
         Node *child = new LeafNode();
         child->DeserializeFrom(buffer, current_size, false);
-        this->AddChild(i, child);  // add pointer to children in indexnode
-      } else {                     // second level of page is indexnode
+        // add pointer to children in indexnode, keeping the version and hash
+        // read above
+        this->AddChild(i, child, get<0>(children_[i]), get<1>(children_[i]));
+      } else {  // second level of page is indexnode
         Node *child = new IndexNode();
         child->DeserializeFrom(buffer, current_size, false);
-        this->AddChild(i, child);
+        this->AddChild(i, child, get<0>(children_[i]), get<1>(children_[i]));
       }
     }
   }
 }
 
+// record a new child hash, hash_ is stale until FinalizeHash is called
 void IndexNode::UpdateNode(uint64_t version, int index,
-                           const string &child_hash, uint8_t location_in_page,
-                           DeltaPage *deltapage) {
+                           const Digest &child_hash) {
+  MarkChildDirty(version, index);
+  get<1>(children_[index]) = child_hash;
+}
+
+// mark a child whose node lives in this page as updated, its hash is pulled
+// in by FinalizeHash
+void IndexNode::MarkChildDirty(uint64_t version, int index) {
   version_ = version;
   bitmap_ |= (1 << index);
+  dirty_ |= (1 << index);
   get<0>(children_[index]) = version;
-  get<1>(children_[index]) = child_hash;
+}
+
+// hash a node once after all updates of a commit landed in its page, and
+// emit one DeltaItem per updated child carrying the final hashes. The dirty
+// second level indexnodes of the page are hashed together in one batch.
+void IndexNode::FinalizeHash(uint8_t location_in_page, DeltaPage *deltapage) {
+  if (dirty_ == 0) {
+    return;
+  }
+  char buffers[DMM_NODE_FANOUT][DMM_NODE_FANOUT * HASH_SIZE];
+  HashMessage messages[DMM_NODE_FANOUT];
+  Digest digests[DMM_NODE_FANOUT];
+  int indexes[DMM_NODE_FANOUT];
+  size_t count = 0;
+  for (int i = 0; i < DMM_NODE_FANOUT; i++) {
+    Node *child = get<2>(children_[i]);
+    if ((dirty_ & (1 << i)) && child != nullptr && !child->IsLeaf() &&
+        static_cast<IndexNode *>(child)->dirty_ != 0) {
+      IndexNode *index_child = static_cast<IndexNode *>(child);
+      messages[count] = {buffers[count],
+                         index_child->ConcatChildHashes(buffers[count])};
+      indexes[count++] = i;
+    }
+  }
+  HashBatch(messages, count, digests);
+  for (size_t k = 0; k < count; k++) {
+    IndexNode *index_child =
+        static_cast<IndexNode *>(get<2>(children_[indexes[k]]));
+    index_child->hash_ = digests[k];
+    index_child->EmitDirtyChildren(indexes[k] + 1, deltapage);
+  }
 
-  string concatenated_hash;
   for (int i = 0; i < DMM_NODE_FANOUT; i++) {
-    concatenated_hash += get<1>(children_[i]);
+    Node *child = get<2>(children_[i]);
+    if ((dirty_ & (1 << i)) && child != nullptr) {
+      get<1>(children_[i]) = child->GetHash();
+    }
   }
-  hash_ = HashFunction(concatenated_hash);
+  CalculateHash();
+  EmitDirtyChildren(location_in_page, deltapage);
+}
+
+void IndexNode::EmitDirtyChildren(uint8_t location_in_page,
+                                  DeltaPage *deltapage) {
   if (deltapage != nullptr) {
-    deltapage->AddIndexNodeUpdate(location_in_page, version, hash_, index,
-                                  child_hash);
+    for (int i = 0; i < DMM_NODE_FANOUT; i++) {
+      if (dirty_ & (1 << i)) {
+        deltapage->AddIndexNodeUpdate(location_in_page, version_, hash_, i,
+                                      get<1>(children_[i]));
+      }
+    }
   }
+  dirty_ = 0;
 }
 
 void IndexNode::AddChild(int index, Node *child, uint64_t version,
-                         const string &hash) {
+                         const Digest &hash) {
   if (index >= 0 && index < DMM_NODE_FANOUT) {
     children_[index] = make_tuple(version, hash, child);
     bitmap_ |= (1 << index);  // update bitmap
@@ -372,7 +441,7 @@ bool IndexNode::HasChild(int index) const {
   return bitmap_ & (1 << index) ? true : false;
 }
 
-void IndexNode::SetChild(int index, uint64_t version, string hash) {
+void IndexNode::SetChild(int index, uint64_t version, const Digest &hash) {
   if (index >= 0 && index < DMM_NODE_FANOUT) {
     get<0>(children_[index]) = version;
     get<1>(children_[index]) = hash;
@@ -381,22 +450,32 @@ void IndexNode::SetChild(int index, uint64_t version, string hash) {
     throw runtime_error("SetChild out of range.");
 }
 
-string IndexNode::GetChildHash(int index) { return get<1>(children_[index]); }
+Digest IndexNode::GetChildHash(int index) { return get<1>(children_[index]); }
 uint64_t IndexNode::GetChildVersion(int index) {
   return get<0>(children_[index]);
 }
 
-string IndexNode::GetHash() { return hash_; }
+Digest IndexNode::GetHash() { return hash_; }
 uint64_t IndexNode::GetVersion() { return version_; }
 void IndexNode::SetVersion(uint64_t version) { version_ = version; }
-void IndexNode::SetHash(string hash) { hash_ = hash; }
+void IndexNode::SetHash(const Digest &hash) { hash_ = hash; }
 
 bool IndexNode::IsLeaf() const { return is_leaf_; }
 
+size_t IndexNode::MemoryUsage() const {
+  size_t bytes = sizeof(IndexNode);
+  for (const auto &child : children_) {
+    if (get<2>(child) != nullptr) {
+      bytes += get<2>(child)->MemoryUsage();
+    }
+  }
+  return bytes;
+}
+
 NodeProof IndexNode::GetNodeProof(int level, int index) {
   NodeProof node_proof = {level, index, bitmap_};
   for (int i = 0; i < DMM_NODE_FANOUT; i++) {
-    node_proof.sibling_hash.push_back(GetChildHash(i));
+    node_proof.sibling_hash[i] = GetChildHash(i);
   }
   return node_proof;
 }
@@ -418,6 +497,10 @@ bool DeltaPage::Deserialize(std::ifstream &in) {
     last_pagekey_.pid = string(pid_buffer.data(), pid_size);
     // Read update_count_
     in.read(reinterpret_cast<char *>(&update_count_), sizeof(uint16_t));
+    // Read hash algorithm and digest width
+    char hash_format[kHashFormatSize];
+    in.read(hash_format, kHashFormatSize);
+    CheckHashFormat(hash_format);
     // Read number of DeltaItems
     size_t items_count;
     in.read(reinterpret_cast<char *>(&items_count), sizeof(items_count));
@@ -462,6 +545,8 @@ bool DeltaPage::Deserialize(char *buffer) {
   current_size += pid_size;
   update_count_ = *(reinterpret_cast<uint16_t *>(buffer + current_size));
   current_size += sizeof(uint16_t);
+  CheckHashFormat(buffer + current_size);
+  current_size += kHashFormatSize;
   for (int i = 0; i < update_count_; i++) {
     deltaitems_.push_back(DeltaItem(buffer, current_size));
   }
@@ -486,6 +571,10 @@ void DeltaPage::SerializeTo(std::ofstream &out) const {
   out.write(last_pagekey_.pid.c_str(), pid_size);
   // 写入 update_count_
   out.write(reinterpret_cast<const char *>(&update_count_), sizeof(uint16_t));
+  // 写入哈希算法和 digest 宽度
+  char hash_format[kHashFormatSize];
+  WriteHashFormat(hash_format);
+  out.write(hash_format, kHashFormatSize);
   // 写入实际的 deltaitems_ 数量
   size_t items_count = deltaitems_.size();
   out.write(reinterpret_cast<const char *>(&items_count), sizeof(items_count));
@@ -496,8 +585,8 @@ void DeltaPage::SerializeTo(std::ofstream &out) const {
 }
 
 DeltaPage::DeltaItem::DeltaItem(uint8_t loc, bool leaf, uint64_t ver,
-                                const string &h, uint64_t fID, uint64_t off,
-                                uint64_t sz, uint8_t idx, const string &ch_hash)
+                                const Digest &h, uint64_t fID, uint64_t off,
+                                uint64_t sz, uint8_t idx, const Digest &ch_hash)
     : location_in_page(loc),
       is_leaf_node(leaf),
       version(ver),
@@ -519,7 +608,7 @@ DeltaPage::DeltaItem::DeltaItem(char *buffer, size_t &current_size) {
   current_size += sizeof(bool);
   version = *(reinterpret_cast<uint64_t *>(buffer + current_size));
   current_size += sizeof(uint64_t);
-  hash = string(buffer + current_size, HASH_SIZE);
+  memcpy(hash.data(), buffer + current_size, HASH_SIZE);
   current_size += HASH_SIZE;
 
   if (is_leaf_node) {
@@ -535,7 +624,7 @@ DeltaPage::DeltaItem::DeltaItem(char *buffer, size_t &current_size) {
       throw runtime_error("index out of range");
     }
     current_size += sizeof(uint8_t);
-    child_hash = string(buffer + current_size, HASH_SIZE);
+    memcpy(child_hash.data(), buffer + current_size, HASH_SIZE);
     current_size += HASH_SIZE;
   }
 }
@@ -560,7 +649,7 @@ void DeltaPage::DeltaItem::SerializeTo(char *buffer,
   // uint32_t hash_length = hash.length();
   // memcpy(buffer + current_size, &hash_length, sizeof(uint32_t));
   // current_size += sizeof(uint32_t);
-  memcpy(buffer + current_size, hash.c_str(), HASH_SIZE);
+  memcpy(buffer + current_size, hash.data(), HASH_SIZE);
   current_size += HASH_SIZE;
 
   if (is_leaf_node) {
@@ -579,7 +668,7 @@ void DeltaPage::DeltaItem::SerializeTo(char *buffer,
     }
     current_size += sizeof(uint8_t);
     // Write child_hash length and child_hash
-    memcpy(buffer + current_size, child_hash.c_str(), HASH_SIZE);
+    memcpy(buffer + current_size, child_hash.data(), HASH_SIZE);
     current_size += HASH_SIZE;
   }
 }
@@ -590,7 +679,7 @@ void DeltaPage::DeltaItem::SerializeTo(std::ofstream &out) const {
   out.write(reinterpret_cast<const char *>(&is_leaf_node),
             sizeof(is_leaf_node));
   out.write(reinterpret_cast<const char *>(&version), sizeof(version));
-  out.write(hash.c_str(), HASH_SIZE);
+  out.write(hash.data(), HASH_SIZE);
 
   if (is_leaf_node) {
     out.write(reinterpret_cast<const char *>(&fileID), sizeof(fileID));
@@ -601,7 +690,7 @@ void DeltaPage::DeltaItem::SerializeTo(std::ofstream &out) const {
     if (index >= DMM_NODE_FANOUT) {
       throw runtime_error("index out of range");
     }
-    out.write(child_hash.c_str(), HASH_SIZE);
+    out.write(child_hash.data(), HASH_SIZE);
   }
 }
 
@@ -617,9 +706,7 @@ bool DeltaPage::DeltaItem::Deserialize(std::ifstream &in) {
     in.read(reinterpret_cast<char *>(&version), sizeof(uint64_t));
 
     // Read hash
-    char hash_buffer[HASH_SIZE];
-    in.read(hash_buffer, HASH_SIZE);
-    hash = string(hash_buffer, HASH_SIZE);
+    in.read(hash.data(), HASH_SIZE);
 
     if (is_leaf_node) {
       // Read leaf node specific fields
@@ -629,7 +716,7 @@ bool DeltaPage::DeltaItem::Deserialize(std::ifstream &in) {
 
       // Initialize unused index node fields
       index = 0;
-      child_hash = "";
+      child_hash = Digest();
     } else {
       // Read index node specific fields
 
@@ -637,9 +724,7 @@ bool DeltaPage::DeltaItem::Deserialize(std::ifstream &in) {
       if (index >= DMM_NODE_FANOUT) {
         throw runtime_error("index out of range");
       }
-      char child_hash_buffer[HASH_SIZE];
-      in.read(child_hash_buffer, HASH_SIZE);
-      child_hash = string(child_hash_buffer, HASH_SIZE);
+      in.read(child_hash.data(), HASH_SIZE);
 
       // Initialize unused leaf node fields
       fileID = 0;
@@ -699,6 +784,8 @@ DeltaPage::DeltaPage(char *buffer) : b_update_count_(0) {
   current_size += pid_size;
   update_count_ = *(reinterpret_cast<uint16_t *>(buffer + current_size));
   current_size += sizeof(uint16_t);
+  CheckHashFormat(buffer + current_size);
+  current_size += kHashFormatSize;
   for (int i = 0; i < update_count_; i++) {
     deltaitems_.push_back(DeltaItem(buffer, current_size));
   }
@@ -716,8 +803,8 @@ DeltaPage::~DeltaPage() {
 }
 
 void DeltaPage::AddIndexNodeUpdate(uint8_t location, uint64_t version,
-                                   const string &hash, uint8_t index,
-                                   const string &child_hash) {
+                                   const Digest &hash, uint8_t index,
+                                   const Digest &child_hash) {
   deltaitems_.push_back(
       DeltaItem(location, false, version, hash, 0, 0, 0, index, child_hash));
   ++update_count_;
@@ -725,7 +812,7 @@ void DeltaPage::AddIndexNodeUpdate(uint8_t location, uint64_t version,
 }
 
 void DeltaPage::AddLeafNodeUpdate(uint8_t location, uint64_t version,
-                                  const string &hash, uint64_t fileID,
+                                  const Digest &hash, uint64_t fileID,
                                   uint64_t offset, uint64_t size) {
   deltaitems_.push_back(
       DeltaItem(location, true, version, hash, fileID, offset, size));
@@ -751,6 +838,8 @@ size_t DeltaPage::SerializeTo() {
 
   memcpy(buffer + current_size, &update_count_, sizeof(uint16_t));
   current_size += sizeof(uint16_t);
+  WriteHashFormat(buffer + current_size);
+  current_size += kHashFormatSize;
 
   for (const auto &item : deltaitems_) {
     if (current_size + sizeof(DeltaItem) > PAGE_SIZE) {  // exceeds page size
@@ -830,6 +919,9 @@ BasePage::BasePage(DMMTrie *trie, char *buffer) : trie_(trie) {
              pid_size);  // deserialize pid (pid_size bytes)
   current_size += pid_size;
 
+  CheckHashFormat(buffer + current_size);  // hash algorithm and digest width
+  current_size += kHashFormatSize;
+
   bool is_leaf_node = *(reinterpret_cast<bool *>(buffer + current_size));
   current_size += sizeof(bool);
 
@@ -852,21 +944,21 @@ BasePage::BasePage(DMMTrie *trie, string key, string pid, string nibbles)
   //   cout << "new BasePage" << endl;
   // #endif
   if (nibbles.size() == 0) {  // leafnode
-    root_ = new LeafNode(0, key, {}, "");
+    root_ = new LeafNode(0, key, {}, Digest());
   } else if (nibbles.size() == 1) {  // indexnode->leafnode
-    Node *child_node = new LeafNode(0, key, {}, "");
-    root_ = new IndexNode(0, "", 0);
+    Node *child_node = new LeafNode(0, key, {}, Digest());
+    root_ = new IndexNode(0, Digest(), 0);
 
     int index = GetIndex(nibbles[0]);
-    root_->AddChild(index, child_node, 0, "");
+    root_->AddChild(index, child_node, 0, Digest());
   } else {  // indexnode->indexnode
     int index = GetIndex(nibbles[1]);
     // second level of indexnode should route its child by bitmap
-    Node *child_node = new IndexNode(0, "", 1 << index);
-    root_ = new IndexNode(0, "", 0);
+    Node *child_node = new IndexNode(0, Digest(), 1 << index);
+    root_ = new IndexNode(0, Digest(), 0);
 
     index = GetIndex(nibbles[0]);
-    root_->AddChild(index, child_node, 0, "");
+    root_->AddChild(index, child_node, 0, Digest());
   }
 }
 
@@ -874,6 +966,9 @@ BasePage::~BasePage() {
   // #ifdef DEBUG
   //   cout << "delete BasePage" << endl;
   // #endif
+  if (root_ == nullptr) {  // empty page
+    return;
+  }
   for (int i = 0; i < DMM_NODE_FANOUT; i++) {
     if (root_->HasChild(i)) {
       delete root_->GetChild(i);
@@ -884,9 +979,10 @@ BasePage::~BasePage() {
 
 /* serialized BasePage format (size in bytes):
    | version (8) | tid (8) | tp (1) | pid_size (8 in 64-bit system) | pid
-   (pid_size) | root node | */
-size_t BasePage::SerializeTo() {
-  char *buffer = this->GetData();
+   (pid_size) | hash_algorithm (1) | hash_size (1) | root node | */
+size_t BasePage::SerializeTo() { return SerializeTo(this->GetData()); }
+
+size_t BasePage::SerializeTo(char *buffer) {
   size_t current_size = 0;
 
   uint64_t version = root_->GetVersion();
@@ -906,6 +1002,8 @@ size_t BasePage::SerializeTo() {
   current_size += sizeof(pid_size);
   memcpy(buffer + current_size, GetPageKey().pid.c_str(), pid_size);  // pid
   current_size += pid_size;
+  WriteHashFormat(buffer + current_size);  // hash algorithm and digest width
+  current_size += kHashFormatSize;
 
   root_->SerializeTo(buffer, current_size, true);  // serialize nodes
   return current_size;
@@ -913,51 +1011,55 @@ size_t BasePage::SerializeTo() {
 
 void BasePage::UpdatePage(uint64_t version,
                           tuple<uint64_t, uint64_t, uint64_t> location,
-                          const string &value, const string &nibbles,
-                          const string &child_hash, DeltaPage *deltapage,
-                          PageKey pagekey) {
-  // parameter "nibbles" are the first two nibbles after pid
+                          string_view nibbles, const Digest &hash,
+                          DeltaPage *deltapage, PageKey pagekey) {
+  // parameter "nibbles" are the first two nibbles after pid, "hash" is the
+  // hash of the value for leafnodes and the root hash of the child page for
+  // indexnodes
   if (nibbles.size() == 0) {
     // page has one leafnode, eg. page "abcdef" for key "abcdef"
     if (!root_) {
-      root_ = new LeafNode(0, pagekey.pid, {}, "");
+      root_ = new LeafNode(0, pagekey.pid, {}, Digest());
     }
-    static_cast<LeafNode *>(root_)->UpdateNode(version, location, value, 0,
+    static_cast<LeafNode *>(root_)->UpdateNode(version, location, hash, 0,
                                                deltapage);
   } else if (nibbles.size() == 1) {
     // page has one indexnode and one level of leafnodes, eg. page "abcd" for
     // key "abcde"
     if (!root_) {
-      root_ = new IndexNode(0, "", 0);
+      root_ = new IndexNode(0, Digest(), 0);
     }
     int index = GetIndex(nibbles[0]);
     if (!root_->HasChild(index)) {
       Node *child_node =
-          new LeafNode(0, pagekey.pid + to_string(index), {}, "");
-      root_->AddChild(index, child_node, 0, "");
+          new LeafNode(0, pagekey.pid + to_string(index), {}, Digest());
+      root_->AddChild(index, child_node, 0, Digest());
     }
     static_cast<LeafNode *>(root_->GetChild(index))
-        ->UpdateNode(version, location, value, index + 1, deltapage);
-
-    string child_hash_2 = root_->GetChild(index)->GetHash();
-    static_cast<IndexNode *>(root_)->UpdateNode(version, index, child_hash_2, 0,
-                                                deltapage);
+        ->UpdateNode(version, location, hash, index + 1, deltapage);
+    static_cast<IndexNode *>(root_)->MarkChildDirty(version, index);
   } else {
     // page has two levels of indexnodes , eg. page "ab" for key "abcdef"
     if (!root_) {
-      root_ = new IndexNode(0, "", 0);
+      root_ = new IndexNode(0, Digest(), 0);
     }
     int index = GetIndex(nibbles[0]), child_index = GetIndex(nibbles[1]);
     if (!root_->HasChild(index)) {
-      Node *child_node = new IndexNode(0, "", 1 << child_index);
-      root_->AddChild(index, child_node, 0, "");
+      Node *child_node = new IndexNode(0, Digest(), 1 << child_index);
+      root_->AddChild(index, child_node, 0, Digest());
     }
     static_cast<IndexNode *>(root_->GetChild(index))
-        ->UpdateNode(version, child_index, child_hash, index + 1, deltapage);
+        ->UpdateNode(version, child_index, hash);
+    static_cast<IndexNode *>(root_)->MarkChildDirty(version, index);
+  }
+}
 
-    string child_hash_2 = root_->GetChild(index)->GetHash();
-    static_cast<IndexNode *>(root_)->UpdateNode(version, index, child_hash_2, 0,
-                                                deltapage);
+// called once after all UpdatePage calls of a commit on this page: hashes the
+// dirty indexnodes, then freezes the deltapage or checkpoints the page
+void BasePage::FinalizePage(uint64_t version, DeltaPage *deltapage,
+                            PageKey pagekey) {
+  if (root_ != nullptr && !root_->IsLeaf()) {
+    static_cast<IndexNode *>(root_)->FinalizeHash(0, deltapage);
   }
 
   this->SetPageKey(pagekey);
@@ -1014,7 +1116,7 @@ void BasePage::UpdateDeltaItem(const DeltaPage::DeltaItem &deltaitem) {
       node = root_;
     } else if (!root_->HasChild(deltaitem.location_in_page - 1)) {
       node = new LeafNode();
-      root_->AddChild(deltaitem.location_in_page - 1, node, 0, "");
+      root_->AddChild(deltaitem.location_in_page - 1, node, 0, Digest());
     } else {
       node = root_->GetChild(deltaitem.location_in_page - 1);
     }
@@ -1028,7 +1130,7 @@ void BasePage::UpdateDeltaItem(const DeltaPage::DeltaItem &deltaitem) {
       node = root_;
     } else if (!root_->HasChild(deltaitem.location_in_page - 1)) {
       node = new IndexNode();
-      root_->AddChild(deltaitem.location_in_page - 1, node, 0, "");
+      root_->AddChild(deltaitem.location_in_page - 1, node, 0, Digest());
     } else {
       node = root_->GetChild(deltaitem.location_in_page - 1);
     }
@@ -1044,34 +1146,80 @@ void BasePage::UpdateDeltaItem(const DeltaPage::DeltaItem &deltaitem) {
 
 Node *BasePage::GetRoot() const { return root_; }
 
+size_t BasePage::MemoryUsage() const {
+  size_t bytes = sizeof(BasePage) + StringHeapBytes(GetPageKey().pid);
+  if (GetData() != nullptr) {
+    bytes += PAGE_SIZE;  // serialization buffer
+  }
+  if (root_ != nullptr) {
+    bytes += root_->MemoryUsage();
+  }
+  return bytes;
+}
+
 DMMTrie::DMMTrie(uint64_t tid, LSVPS *page_store, VDLS *value_store,
-                 uint64_t current_version)
+                 uint64_t current_version, size_t commit_threads,
+                 size_t cache_bytes, CachePolicyType cache_policy,
+                 size_t pinned_levels)
     : tid(tid),
       page_store_(page_store),
       value_store_(value_store),
       current_version_(current_version),
-      root_page_(nullptr) {
-  lru_cache_.clear();
-  pagekeys_.clear();
+      root_page_(nullptr),
+      lru_cache_(cache_bytes, cache_policy, pinned_levels),
+      writer_waiting_(false),
+      committed_version_(current_version),
+      commit_failed_(false),
+      key_filter_version_(0) {
+  if (commit_threads > 1) {
+    commit_pool_ = make_unique<ThreadPool>(commit_threads);
+  }
   active_deltapages_.clear();
   page_versions_.clear();
   page_cache_.clear();
-  put_cache_.clear();
+  write_buffer_.Clear();
   deltapage_versions_.clear();
+  basepage_versions_.clear();
 }
 
 DMMTrie::~DMMTrie() {
-  while (lru_cache_.size()) {  // cache is full
-    PageKey last_key = pagekeys_.back().first;
-    auto last_iter = lru_cache_.find(last_key);
-    delete last_iter->second->second;  // release memory of basepage
+  try {
+    WaitForCommit();  // lru_cache_ releases the pages
+  } catch (const exception &e) {
+    cerr << "commit failed: " << e.what() << endl;
+  }
+}
+
+DMMTrie::ReadGuard::ReadGuard(DMMTrie *trie, uint64_t version) : trie_(trie) {
+  if (version > trie_->committed_version_ ||
+      trie_->commit_failed_.load(memory_order_acquire)) {
+    trie_->WaitForCommit();
+  }
+  while (trie_->writer_waiting_.load(memory_order_acquire)) {
+    this_thread::yield();
+  }
+  trie_->page_mutex_.lock_shared();
+}
 
-    // remove the page whose pagekey is at the tail of list
-    lru_cache_.erase(last_key);
-    pagekeys_.pop_back();
+DMMTrie::ReadGuard::~ReadGuard() {
+  trie_->page_mutex_.unlock_shared();
+  // pages evicted by readers are freed once no reader can hold them, which
+  // the next commit also does
+  if (trie_->lru_cache_.RetiredCount() >= kRetiredPagesThreshold) {
+    unique_lock<shared_mutex> lock(trie_->page_mutex_, try_to_lock);
+    if (lock.owns_lock()) {
+      trie_->lru_cache_.ReleaseRetired();
+    }
   }
 }
 
+unique_lock<shared_mutex> DMMTrie::LockPages() {
+  writer_waiting_.store(true, memory_order_release);
+  unique_lock<shared_mutex> lock(page_mutex_);
+  writer_waiting_.store(false, memory_order_release);
+  return lock;
+}
+
 bool DMMTrie::Put(uint64_t tid, uint64_t version, const string &key,
                   const string &value) {
   if (version < current_version_) {  // version invalid
@@ -1082,43 +1230,66 @@ bool DMMTrie::Put(uint64_t tid, uint64_t version, const string &key,
     cout << "Value cannot be empty string" << endl;
     return false;
   }
+  if (!CheckKey(key)) {
+    return false;
+  }
   current_version_ = version;
-  put_cache_[key] = value;
+  write_buffer_.Put(key, value);
   return true;
 }
 
 string DMMTrie::Get(uint64_t tid, uint64_t version, const string &key) {
-  string nibble_path = key;
+  return string(GetView(tid, version, key));
+}
+
+string_view DMMTrie::GetView(uint64_t tid, uint64_t version,
+                             const string &key) {
+  ReadGuard guard(this, version);
+  const LatestIndex::Entry *latest = FindLatest(version, key);
+  if (latest != nullptr) {  // one probe instead of the page walk
+    return value_store_->ReadValueView(latest->location);
+  }
+  if (!MayContain(version, key)) {
+    return "";
+  }
+  // the key is decoded once, every page on the path is looked up with a
+  // packed key built from it without allocating
+  NibblePath path(key);
+  if (!path.Valid()) {
+    cout << "Key " << key << " not found at version " << version << endl;
+    return "";
+  }
   uint64_t page_version = version;
   LeafNode *leafnode = nullptr;
-  for (int i = 0; i <= key.size(); i += 2) {
-    string pid = nibble_path.substr(0, i);
-    BasePage *page =
-        GetPage({page_version, 0, false, pid});  // false means basepage
+  for (size_t i = 0; i <= path.Size(); i += 2) {
+    BasePage *page = GetPage(path.PageKeyAt(page_version, 0, false, i),
+                             path.Prefix(i));  // false means basepage
     if (page == nullptr || page->GetRoot() == nullptr) {
       cout << "Key " << key << " not found at version " << version << endl;
       return "";
     }
 
-    if (!page->GetRoot()->IsLeaf()) {  // first level in page is indexnode
-
-      if (!page->GetRoot()->HasChild(GetIndex(nibble_path[i]))) {
+    Node *root = page->GetRoot();
+    if (!root->IsLeaf()) {  // first level in page is indexnode
+      if (i >= path.Size() || !root->HasChild(path.Nibble(i))) {
         cout << "Child not found" << endl;
         cout << "Key " << key << " not found at version " << version << endl;
         return "";
       }
-      if (!page->GetRoot()->GetChild(GetIndex(nibble_path[i]))->IsLeaf()) {
+      Node *child = root->GetChild(path.Nibble(i));
+      if (!child->IsLeaf()) {
         // second level is indexnode
         // TODO: child的版本比Root高是正常的吗？
-        page_version = page->GetRoot()
-                           ->GetChild(GetIndex(nibble_path[i]))
-                           ->GetChildVersion(GetIndex(nibble_path[i + 1]));
+        if (i + 1 >= path.Size()) {
+          cout << "Key " << key << " not found at version " << version << endl;
+          return "";
+        }
+        page_version = child->GetChildVersion(path.Nibble(i + 1));
       } else {  // second level is leafnode
-        leafnode = static_cast<LeafNode *>(
-            page->GetRoot()->GetChild(GetIndex(nibble_path[i])));
+        leafnode = static_cast<LeafNode *>(child);
       }
     } else {  // first level is leafnode
-      leafnode = static_cast<LeafNode *>(page->GetRoot());
+      leafnode = static_cast<LeafNode *>(root);
     }
   }
   tuple<uint64_t, uint64_t, uint64_t> location = leafnode->GetLocation();
@@ -1126,7 +1297,7 @@ string DMMTrie::Get(uint64_t tid, uint64_t version, const string &key) {
   cout << "location:" << get<0>(location) << " " << get<1>(location) << " "
        << get<2>(location) << endl;
 #endif
-  string value = value_store_->ReadValue(leafnode->GetLocation());
+  string_view value = value_store_->ReadValueView(leafnode->GetLocation());
 #ifdef DEBUG
   cout << "Key " << key << " has value " << value << " at version " << version
        << endl;
@@ -1134,167 +1305,488 @@ string DMMTrie::Get(uint64_t tid, uint64_t version, const string &key) {
   return value;
 }
 
+vector<string> DMMTrie::MultiGet(uint64_t tid, uint64_t version,
+                                const vector<string> &keys) {
+  ReadGuard guard(this, version);
+  vector<string> values(keys.size());
+  vector<size_t> order(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    order[i] = i;
+  }
+  sort(order.begin(), order.end(),
+       [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+  // resolve the leaf locations of all keys, then read them in log order so
+  // every data file is mapped once
+  vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> locations;
+  locations.reserve(keys.size());
+  vector<size_t> valid_order;  // keys that can be stored in the trie
+  valid_order.reserve(order.size());
+  for (size_t i : order) {
+    const LatestIndex::Entry *latest = FindLatest(version, keys[i]);
+    if (latest != nullptr) {
+      locations.push_back({latest->location, i});
+      continue;
+    }
+    if (!MayContain(version, keys[i])) {
+      continue;
+    }
+    bool valid = keys[i].size() <= kMaxPidNibbles;
+    for (size_t j = 0; valid && j < keys[i].size(); j++) {
+      valid = NibbleOf(keys[i][j]) >= 0;
+    }
+    if (valid) {
+      valid_order.push_back(i);
+    }
+  }
+  if (!valid_order.empty()) {
+    MultiGetPage(version, 0, keys, valid_order.data(), 0, valid_order.size(),
+                 locations);
+  }
+  ReadValues(locations, values);
+  return values;
+}
+
+void DMMTrie::ReadValues(
+    vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> &locations,
+    vector<string> &values) {
+  sort(locations.begin(), locations.end());
+  for (size_t i = 0; i < locations.size(); i++) {
+    if (i > 0 && locations[i].first == locations[i - 1].first) {
+      values[locations[i].second] = values[locations[i - 1].second];
+    } else {
+      values[locations[i].second] =
+          value_store_->ReadValueView(locations[i].first);
+    }
+  }
+}
+
+vector<pair<uint64_t, string>> DMMTrie::GetHistory(uint64_t tid,
+                                                   const string &key,
+                                                   uint64_t from_version,
+                                                   uint64_t to_version) {
+  ReadGuard guard(this, to_version);
+  vector<pair<uint64_t, string>> history;
+  NibblePath path(key);
+  if (!path.Valid() || from_version > to_version) {
+    return history;
+  }
+  // the leaf of key is the root of the page of its longest even prefix when
+  // the key has an even length, a child of that root otherwise
+  string pid = key.substr(0, key.size() - key.size() % 2);
+  uint8_t location_in_page =
+      key.size() % 2 ? 1 + path.Nibble(key.size() - 1) : 0;
+  // the versions in [from_version, to_version] of pid in page_versions
+  auto versions_in_range =
+      [&](const unordered_map<string, vector<uint64_t>> &page_versions) {
+        vector<uint64_t> versions;
+        auto it = page_versions.find(pid);
+        if (it != page_versions.end()) {
+          auto begin =
+              lower_bound(it->second.begin(), it->second.end(), from_version);
+          versions.assign(begin,
+                          upper_bound(begin, it->second.end(), to_version));
+        }
+        return versions;
+      };
+  vector<uint64_t> delta_versions, base_versions;
+  {
+    lock_guard<mutex> lock(commit_mutex_);
+    delta_versions = versions_in_range(deltapage_versions_);
+    base_versions = versions_in_range(basepage_versions_);
+  }
+  // a commit that changes a page stores a deltapage with its writes, or only
+  // a basepage when it changes too many groups of the page. Just the versions
+  // the page changed at are visited, merged in order; the leaf in such a
+  // basepage was written by its commit when it carries the same version
+  vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> locations;
+  auto add_write = [&](uint64_t version,
+                       const tuple<uint64_t, uint64_t, uint64_t> &location,
+                       bool deleted) {
+    if (!deleted) {  // deletes have no value to read
+      locations.push_back({location, history.size()});
+    }
+    history.push_back({version, ""});
+  };
+  size_t d = 0, b = 0;
+  while (d < delta_versions.size() || b < base_versions.size()) {
+    if (b == base_versions.size() ||
+        (d < delta_versions.size() && delta_versions[d] <= base_versions[b])) {
+      uint64_t version = delta_versions[d++];
+      unique_ptr<DeltaPage> deltapage =
+          page_store_->LoadDeltaPage(pid, version);
+      if (deltapage == nullptr) {
+        throw runtime_error("DeltaPage not found for pid " + pid);
+      }
+      const DeltaPage::DeltaItem *write = nullptr;
+      for (const DeltaPage::DeltaItem &item : deltapage->GetDeltaItems()) {
+        if (item.is_leaf_node && item.location_in_page == location_in_page) {
+          write = &item;
+        }
+      }
+      if (write == nullptr) {  // another key of the page changed
+        continue;
+      }
+      add_write(version, {write->fileID, write->offset, write->size},
+                write->hash.IsEmpty());
+      if (b < base_versions.size() && base_versions[b] == version) {
+        b++;  // the basepage of this version holds the same write
+      }
+      continue;
+    }
+    uint64_t version = base_versions[b++];
+    BasePage *page = GetPage({version, tid, false, pid});
+    Node *leaf = page == nullptr ? nullptr : page->GetRoot();
+    if (leaf != nullptr && location_in_page != 0) {
+      int nibble = location_in_page - 1;
+      leaf = !leaf->IsLeaf() && leaf->HasChild(nibble) ? leaf->GetChild(nibble)
+                                                       : nullptr;
+    }
+    if (leaf == nullptr || !leaf->IsLeaf() || leaf->GetVersion() != version) {
+      continue;  // another key of the page changed
+    }
+    LeafNode *leafnode = static_cast<LeafNode *>(leaf);
+    add_write(version, leafnode->GetLocation(), leafnode->GetHash().IsEmpty());
+  }
+  vector<string> values(history.size());
+  ReadValues(locations, values);
+  for (size_t i = 0; i < history.size(); i++) {
+    history[i].second = std::move(values[i]);
+  }
+  return history;
+}
+
+// resolves keys[order[begin, end)], which share their first depth nibbles and
+// whose page at depth was last updated at version. Keys that end in this page
+// get their leaf location, the others recurse into the child pages
+void DMMTrie::MultiGetPage(
+    uint64_t version, size_t depth, const vector<string> &keys,
+    const size_t *order, size_t begin, size_t end,
+    vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> &locations) {
+  const string &first = keys[order[begin]];
+  NibblePath path(first);
+  BasePage *page = GetPage(path.PageKeyAt(version, 0, false, depth),
+                           path.Prefix(depth));  // one load for all keys
+  if (page == nullptr || page->GetRoot() == nullptr) {
+    return;
+  }
+  Node *root = page->GetRoot();
+  if (root->IsLeaf()) {  // first level is leafnode
+    LeafNode *leafnode = static_cast<LeafNode *>(root);
+    for (size_t i = begin; i < end; i++) {
+      if (keys[order[i]].size() == depth) {
+        locations.push_back({leafnode->GetLocation(), order[i]});
+      }
+    }
+    return;
+  }
+  size_t i = begin;
+  while (i < end) {
+    const string &key = keys[order[i]];
+    if (key.size() <= depth) {  // path ends on an indexnode
+      i++;
+      continue;
+    }
+    // keys are sorted, so keys with the same next nibble are adjacent
+    size_t group_end = i + 1;
+    while (group_end < end && keys[order[group_end]][depth] == key[depth]) {
+      group_end++;
+    }
+    int index = NibbleOf(key[depth]);
+    if (!root->HasChild(index)) {
+      i = group_end;
+      continue;
+    }
+    Node *child = root->GetChild(index);
+    if (child->IsLeaf()) {  // second level is leafnode
+      for (size_t j = i; j < group_end; j++) {
+        if (keys[order[j]].size() == depth + 1) {
+          locations.push_back(
+              {static_cast<LeafNode *>(child)->GetLocation(), order[j]});
+        }
+      }
+      i = group_end;
+      continue;
+    }
+    // second level is indexnode, keys ending after one nibble sort first and
+    // have no child page
+    size_t j = i;
+    while (j < group_end && keys[order[j]].size() == depth + 1) {
+      j++;
+    }
+    while (j < group_end) {
+      char nibble = keys[order[j]][depth + 1];
+      size_t child_end = j + 1;
+      while (child_end < group_end &&
+             keys[order[child_end]][depth + 1] == nibble) {
+        child_end++;
+      }
+      int child_index = NibbleOf(nibble);
+      if (child->HasChild(child_index)) {
+        MultiGetPage(child->GetChildVersion(child_index), depth + 2, keys,
+                     order, j, child_end, locations);
+      }
+      j = child_end;
+    }
+    i = group_end;
+  }
+}
+
+unique_ptr<DMMTrieIterator> DMMTrie::NewIterator(uint64_t tid,
+                                                 uint64_t version,
+                                                 const string &begin,
+                                                 const string &end) {
+  return make_unique<DMMTrieIterator>(this, version, begin, end);
+}
+
 void DMMTrie::Delete(uint64_t tid, uint64_t version, const string &key) {
   if (version < current_version_) {  // version invalid
     cout << "Version " << version << " is outdated!" << endl;
     return;
   }
+  if (!CheckKey(key)) {
+    return;
+  }
   current_version_ = version;
-  put_cache_[key] = "";
+  write_buffer_.Delete(key);
 }
 
-// deprecated
-void DMMTrie::Commit(uint64_t version) { CalcRootHash(0, version); }
-
-void DMMTrie::CalcRootHash(uint64_t tid, uint64_t version) {
-  if (version != current_version_) {
-    cout << "Commit version incompatible" << endl;
+// keys are paths of hexadecimal nibbles no longer than a packed pid
+bool DMMTrie::CheckKey(string_view key) {
+  if (key.size() > kMaxPidNibbles) {
+    cout << "Key " << key << " is longer than " << kMaxPidNibbles
+         << " nibbles" << endl;
+    return false;
   }
-
-  map<string, set<string>, decltype(CompareStrings)> updates(CompareStrings);
-
-  for (const auto &it : put_cache_) {
-    for (int i = it.first.size() % 2 == 0 ? it.first.size()
-                                          : it.first.size() - 1;
-         i >= 0; i -= 2) {
-      // store the pid and nibbles of each page updated in every put
-      updates[it.first.substr(0, i)].insert(it.first.substr(i, 2));
+  for (char ch : key) {
+    if (NibbleOf(ch) < 0) {
+      cout << "Key " << key << " is not hexadecimal" << endl;
+      return false;
     }
   }
+  return true;
+}
 
-  // unordered_map<string, DeltaPage *> active_deltapages;
-  set<string> pids;
+bool DMMTrie::CheckWriteVersion(uint64_t version) {
+  if (version < current_version_) {  // version invalid
+    cout << "Version " << version << " is outdated!" << endl;
+    return false;
+  }
+  current_version_ = version;
+  return true;
+}
 
-  for (const auto &it : put_cache_) {
-    for (int i = it.first.size() % 2 == 0 ? it.first.size()
-                                          : it.first.size() - 1;
-         i >= 0; i -= 2) {
-      pids.insert(it.first.substr(0, i));
+bool DMMTrie::PutBatch(uint64_t tid, uint64_t version,
+                       vector<pair<string, string>> &&kvs) {
+  for (const auto &kv : kvs) {
+    if (kv.second.empty()) {
+      cout << "Value cannot be empty string" << endl;
+      return false;
     }
+    if (!CheckKey(kv.first)) {
+      return false;
+    }
+  }
+  if (!CheckWriteVersion(version)) {
+    return false;
   }
+  write_buffer_.AdoptPuts(std::move(kvs));
+  return true;
+}
 
-  // get the needed active deltapages from LSVPS
-  // for (string pid : pids) {
-  //   active_deltapages[pid] = page_store_->GetActiveDeltaPage(pid);
-  // }
+bool DMMTrie::PutBatch(uint64_t tid, uint64_t version, const KeyValueRef *kvs,
+                       size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (kvs[i].value.empty()) {
+      cout << "Value cannot be empty string" << endl;
+      return false;
+    }
+    if (!CheckKey(kvs[i].key)) {
+      return false;
+    }
+  }
+  if (!CheckWriteVersion(version)) {
+    return false;
+  }
+  write_buffer_.BorrowPuts(kvs, count);
+  return true;
+}
 
-  for (const auto &it : updates) {
-    string pid = it.first;
-    bool if_exceed = false;
-    // get the latest version number of a page
-    uint64_t page_version = GetPageVersion({0, 0, false, pid}).first;
-    PageKey pagekey = {version, 0, false, pid},
-            old_pagekey = {page_version, 0, false, pid};
-    BasePage *page = GetPage(old_pagekey);  // load the page into lru cache
-
-    if (page == nullptr) {
-      // GetPage returns nullptr means that the pid is new
-      page = new BasePage(this, nullptr, pid);
-      PutPage(pagekey, page);  // add the newly generated page into cache
-    }
-
-    // DeltaPage *deltapage = GetDeltaPage(pid);
-
-    DeltaPage *deltapage = page_store_->GetActiveDeltaPage(pid);
-
-    // if (2 * it.second.size() + deltapage->GetDeltaPageUpdateCount() >=
-    //     2 * Td_) {
-    // the updates in page is more than the capacity of two deltapages
-    // directly generate a base page
-    if (2 * it.second.size() + deltapage->GetDeltaPageUpdateCount() >= Td_) {
-      // 只要跨页了就不行，因为只要版本更新了，就会创建delta page。
-      if_exceed = true;
-      if (deltapage->GetDeltaPageUpdateCount() != 0) {
-        PageKey deltapage_pagekey = {version, 0, true, pagekey.pid};
-
-        DeltaPage *deltapage_copy = new DeltaPage(*deltapage);
-        deltapage_copy->SetPageKey(deltapage_pagekey);
-        deltapage_copy->SerializeTo();
-        // store frozen deltapage in cache
-        WritePageCache(deltapage_pagekey, deltapage_copy);
-
-        deltapage->ClearDeltaPage();  // delete all DeltaItems in DeltaPage
-        // record the PageKey of DeltaPage passed to LSVPS
-        deltapage->SetLastPageKey(deltapage_pagekey);
-        AddDeltaPageVersion(pagekey.pid, version);
-      }
+bool DMMTrie::DeleteBatch(uint64_t tid, uint64_t version,
+                          vector<string> &&keys) {
+  for (const auto &key : keys) {
+    if (!CheckKey(key)) {
+      return false;
     }
+  }
+  if (!CheckWriteVersion(version)) {
+    return false;
+  }
+  write_buffer_.AdoptDeletes(std::move(keys));
+  return true;
+}
 
-    for (const auto &nibbles : it.second) {
-      // path is key when page is leaf page, pid of child page when page is
-      // index page
-      string path = pid + nibbles;
-      tuple<uint64_t, uint64_t, uint64_t> location;
-      string value, child_hash;
-      if (nibbles.size() == 2) {  // indexnode + indexnode
-        child_hash = GetPage({version, 0, false, path})->GetRoot()->GetHash();
-      } else {  // (indexnode + leafnode) or leafnode
-        value = put_cache_[path];
-        location = value_store_->WriteValue(version, path, value);
-      }
-      if (if_exceed) {
-        page->UpdatePage(version, location, value, nibbles, child_hash, nullptr,
-                         pagekey);
-      } else {
-        page->UpdatePage(version, location, value, nibbles, child_hash,
-                         deltapage, pagekey);
-      }
+bool DMMTrie::DeleteBatch(uint64_t tid, uint64_t version,
+                          const string_view *keys, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (!CheckKey(keys[i])) {
+      return false;
     }
+  }
+  if (!CheckWriteVersion(version)) {
+    return false;
+  }
+  write_buffer_.BorrowDeletes(keys, count);
+  return true;
+}
 
-    if (if_exceed) {
-      BasePage *basepage_copy = new BasePage(*page);
-      basepage_copy->SerializeTo();
-      WritePageCache(pagekey, basepage_copy);  // store basepage in cache
+// deprecated
+void DMMTrie::Commit(uint64_t version) { CalcRootHash(0, version); }
 
-      UpdatePageVersion(pagekey, version, version);
-      deltapage->ClearBasePageUpdateCount();
-      deltapage->SetLastPageKey(pagekey);
-    }
-    if (deltapage->GetDeltaPageUpdateCount() != 0) {
-      // 不管满没满，delta page的内容都刷入storage
-      PageKey deltapage_pagekey = {version, 0, true, pagekey.pid};
+void DMMTrie::CalcRootHash(uint64_t tid, uint64_t version) {
+  WaitForCommit();
+  if (version != current_version_) {
+    cout << "Commit version incompatible" << endl;
+  }
+  CommitWriteBuffer(version, write_buffer_);
+}
 
-      DeltaPage *deltapage_copy = new DeltaPage(*deltapage);
-      deltapage_copy->SetPageKey(deltapage_pagekey);
-      deltapage_copy->SerializeTo();
-      // store frozen deltapage in cache
-      WritePageCache(deltapage_pagekey, deltapage_copy);
+shared_future<string> DMMTrie::CommitAsync(uint64_t tid, uint64_t version) {
+  WaitForCommit();  // one commit in flight, versions are published in order
+  if (version != current_version_) {
+    cout << "Commit version incompatible" << endl;
+  }
+  // the writes of version move to commit_buffer_, puts of the next version go
+  // to the emptied write_buffer_
+  swap(write_buffer_, commit_buffer_);
+  lock_guard<mutex> lock(pending_mutex_);
+  pending_commit_ = async(launch::async, [this, tid, version]() {
+                      try {
+                        CommitWriteBuffer(version, commit_buffer_);
+                      } catch (...) {
+                        // reads of older versions check this, they do not
+                        // wait for the commit otherwise
+                        commit_failed_.store(true, memory_order_release);
+                        throw;
+                      }
+                      ReadGuard guard(this, version);
+                      return GetPage({version, tid, false, ""})
+                          ->GetRoot()
+                          ->GetHash()
+                          .ToString();
+                    }).share();
+  return pending_commit_;
+}
+
+void DMMTrie::WaitForCommit() {
+  shared_future<string> pending;
+  {
+    lock_guard<mutex> lock(pending_mutex_);
+    pending = pending_commit_;
+  }
+  if (pending.valid()) {
+    // rethrows the error of a failed background commit. The future is kept,
+    // so every later commit and read fails too instead of running over a
+    // version that was half applied and never published
+    pending.get();
+  }
+}
 
-      deltapage->ClearDeltaPage();  // delete all DeltaItems in DeltaPage
-      // record the PageKey of DeltaPage passed to LSVPS
-      deltapage->SetLastPageKey(deltapage_pagekey);
-      AddDeltaPageVersion(pagekey.pid, version);
+void DMMTrie::CommitWriteBuffer(uint64_t version, WriteBuffer &buffer) {
+  // pages ordered by pid length descending, so children are committed before
+  // their parents
+  const vector<WriteBuffer::PageWork> &pages = buffer.Seal();
+  vector<PageUpdate> page_updates(pages.size());
+  for (size_t i = 0; i < pages.size(); i++) {
+    page_updates[i].pid = string(pages[i].pid);
+    page_updates[i].groups = pages[i].groups;
+    page_updates[i].group_count = pages[i].group_count;
+  }
+  LinkChildPages(page_updates);
+  HashLeafValues(page_updates);
+  WriteLeafValues(version, page_updates);
+
+  // readers are held off from here until the new version is published, the
+  // pages they hold are changed in place
+  unique_lock<shared_mutex> pages_lock = LockPages();
+  if (commit_pool_ == nullptr) {
+    for (auto &update : page_updates) {
+      PreparePageUpdate(version, update);
+      ApplyPageUpdate(version, update);
+      FinishPageUpdate(version, update);
+    }
+  } else {
+    // pages with the same pid length only depend on their children, so every
+    // level is committed as one wave with a barrier before its parent level
+    size_t begin = 0;
+    while (begin < page_updates.size()) {
+      size_t pid_size = page_updates[begin].pid.size();
+      size_t end = begin;
+      while (end < page_updates.size() &&
+             page_updates[end].pid.size() == pid_size &&
+             end - begin < kMaxPagesPerWave) {
+        end++;
+      }
+      for (size_t i = begin; i < end; i++) {
+        PreparePageUpdate(version, page_updates[i]);
+        page_store_->PinActiveDeltaPage(page_updates[i].pid);
+      }
+      commit_pool_->ParallelFor(end - begin, [&](size_t i) {
+        ApplyPageUpdate(version, page_updates[begin + i]);
+      });
+      for (size_t i = begin; i < end; i++) {
+        FinishPageUpdate(version, page_updates[i]);
+      }
+      page_store_->UnpinActiveDeltaPages();
+      begin = end;
     }
-    UpdatePageKey(old_pagekey, pagekey);
-    // deltapage->SerializeTo();
-    page_store_->StoreActiveDeltaPage(deltapage);
   }
 
+  // the pages move to the memtable of LSVPS before readers are let in again,
+  // as the active deltapages they may load already point to them. Writing a
+  // full memtable to disk only holds off the loads of LSVPS, and readers of
+  // the version wait until it is published below
   for (const auto &it : page_cache_) {
-    page_store_->StorePage(it.second);
+    page_store_->AdoptPage(it.second);
 #ifdef DEBUG
     std::cout << "Commit" << version
               << " Store Page: " << it.second->GetPageKey() << std::endl;
 #endif
   }
+  page_cache_.clear();
 
   // send the active deltapages back to LSVPS
   // for (const auto &it : active_deltapages) {
   //   page_store_->StoreActiveDeltaPage(it.second);
   // }
-  for (auto &pair : page_cache_) {
-    delete pair.second;
-  }
-  page_cache_.clear();
-  put_cache_.clear();
+  UpdateLatestIndex(version, page_updates);
+  UpdateKeyFilter(buffer);
+  lru_cache_.ReleaseRetired();  // no reader holds a page now
+  pages_lock.unlock();
+  page_store_->FlushTableIfFull();
+  committed_version_ = version;
+  buffer.Clear();
 #ifdef DEBUG
   cout << "Version " << version << " committed" << endl;
   cout << "Active delta pages: " << active_deltapages_.size() << endl;
   cout << "Active delta page size: " << sizeof(active_deltapages_.end()->second)
        << endl;
-  cout << "LRU pages:" << lru_cache_.size() << endl;
+  cout << "LRU pages:" << lru_cache_.Size()
+       << ", bytes:" << lru_cache_.MemoryUsage()
+       << ", pinned pages:" << lru_cache_.PinnedSize()
+       << ", pinned bytes:" << lru_cache_.PinnedMemoryUsage() << endl;
   cout << "page_cache_:" << page_cache_.size() << endl;
-  cout << "pagekeys_:" << pagekeys_.size() << endl;
+  if (latest_index_ != nullptr) {
+    cout << "latest index keys:" << latest_index_->Size()
+         << ", skipped:" << latest_index_->Skipped()
+         << ", memory:" << latest_index_->MemoryUsage() << " bytes" << endl;
+  }
+  if (key_filter_ != nullptr) {
+    cout << "key filter keys:" << key_filter_->Size()
+         << ", layers:" << key_filter_->Layers()
+         << ", estimated fp rate:" << key_filter_->EstimatedFalsePositiveRate()
+         << ", memory:" << key_filter_->MemoryUsage() << " bytes" << endl;
+  }
 
   std::ifstream file("/proc/self/status");
   std::string line;
@@ -1312,50 +1804,357 @@ void DMMTrie::CalcRootHash(uint64_t tid, uint64_t version) {
 #endif
 }
 
+// the pages of one commit are sorted by pid length, then pid. Every index
+// group of a level names exactly one page two nibbles deeper and the groups
+// are sorted like those pages, so the children of a level are found by
+// walking the level below with a cursor instead of looking them up.
+void DMMTrie::LinkChildPages(vector<PageUpdate> &page_updates) {
+  size_t begin = 0, child_level = 0;
+  while (begin < page_updates.size()) {
+    size_t pid_size = page_updates[begin].pid.size();
+    // the level below is the one just before this level, if it exists
+    const PageUpdate *child = nullptr;
+    if (begin > 0 && page_updates[child_level].pid.size() == pid_size + 2) {
+      child = &page_updates[child_level];
+    }
+    size_t end = begin;
+    for (; end < page_updates.size() &&
+           page_updates[end].pid.size() == pid_size;
+         end++) {
+      PageUpdate &update = page_updates[end];
+      update.children = child;
+      for (size_t i = 0; i < update.group_count; i++) {
+        if (!update.groups[i].IsLeaf()) {
+#ifdef DEBUG
+          if (child == nullptr ||
+              child->groups[0].pid() != update.groups[i].path) {
+            cout << "child page of " << update.groups[i].path << " not found"
+                 << endl;
+          }
+#endif
+          child++;
+        }
+      }
+    }
+    child_level = begin;
+    begin = end;
+  }
+}
+
+// hash the values of every leaf updated in this commit in one batch. Deleted
+// keys have an empty value and keep the empty digest.
+void DMMTrie::HashLeafValues(vector<PageUpdate> &page_updates) {
+  vector<HashMessage> messages;
+  vector<Digest *> targets;
+  for (auto &update : page_updates) {
+    update.hashes.assign(update.group_count, Digest());
+    for (size_t i = 0; i < update.group_count; i++) {
+      const WriteBuffer::NibbleGroup &group = update.groups[i];
+      if (group.IsLeaf()) {  // (indexnode + leafnode) or leafnode
+        string_view value = group.entry->value;
+        if (!value.empty()) {
+          messages.push_back({value.data(), value.size()});
+          targets.push_back(&update.hashes[i]);
+        }
+      }
+    }
+  }
+  vector<Digest> digests(messages.size());
+  HashBatch(messages.data(), messages.size(), digests.data());
+  for (size_t i = 0; i < digests.size(); i++) {
+    *targets[i] = digests[i];
+  }
+}
+
+// append the values of every leaf updated in this commit to the value store
+// in one pass, in page order. The records are taken from the write buffer.
+void DMMTrie::WriteLeafValues(uint64_t version,
+                              vector<PageUpdate> &page_updates) {
+  vector<KeyValueRef> records;
+  vector<tuple<uint64_t, uint64_t, uint64_t> *> targets;
+  for (auto &update : page_updates) {
+    update.locations.assign(update.group_count, {});
+    for (size_t i = 0; i < update.group_count; i++) {
+      const WriteBuffer::NibbleGroup &group = update.groups[i];
+      if (group.IsLeaf()) {  // (indexnode + leafnode) or leafnode
+        // path is the key for leaf updates
+        records.push_back({group.path, group.entry->value});
+        targets.push_back(&update.locations[i]);
+      }
+    }
+  }
+  vector<tuple<uint64_t, uint64_t, uint64_t>> locations(records.size());
+  value_store_->WriteValues(version, records.data(), records.size(),
+                            locations.data());
+  for (size_t i = 0; i < locations.size(); i++) {
+    *targets[i] = locations[i];
+  }
+}
+
+void DMMTrie::UpdateLatestIndex(uint64_t version,
+                                const vector<PageUpdate> &page_updates) {
+  if (latest_index_ == nullptr) {
+    return;
+  }
+  for (const auto &update : page_updates) {
+    for (size_t i = 0; i < update.group_count; i++) {
+      const WriteBuffer::NibbleGroup &group = update.groups[i];
+      if (group.IsLeaf()) {  // path is the key for leaf updates
+        latest_index_->Update(version, group.path, update.locations[i],
+                              update.hashes[i]);
+      }
+    }
+  }
+  latest_index_->Publish(version);
+}
+
+void DMMTrie::EnableLatestIndex(size_t max_bytes) {
+  WaitForCommit();
+  unique_lock<shared_mutex> pages_lock = LockPages();
+  // the index only learns keys written from now on, older keys are read
+  // through the trie
+  latest_index_ = make_unique<LatestIndex>(max_bytes);
+}
+
+const LatestIndex *DMMTrie::GetLatestIndex() const {
+  return latest_index_.get();
+}
+
+// the writes of a commit are added before the version is published. Deletes
+// leave their key in the filter
+void DMMTrie::UpdateKeyFilter(const WriteBuffer &buffer) {
+  if (key_filter_ == nullptr) {
+    return;
+  }
+  for (const WriteBuffer::Entry &entry : buffer.Entries()) {
+    if (!entry.value.empty()) {
+      key_filter_->Add(entry.key);
+    }
+  }
+}
+
+void DMMTrie::EnableKeyFilter(double fp_rate, size_t expected_keys) {
+  WaitForCommit();
+  uint64_t version = committed_version_;
+  auto filter = make_unique<KeyFilter>(fp_rate, expected_keys);
+  uint64_t saved_version = 0;
+  string filepath = page_store_->GetIndexFilePath() + kKeyFilterFile;
+  if (!filter->LoadFrom(filepath, saved_version) || saved_version != version ||
+      filter->FalsePositiveRate() != fp_rate) {
+    filter = make_unique<KeyFilter>(fp_rate, expected_keys);
+    if (version > 0) {  // the keys of the newest version
+      DMMTrieIterator it(this, version, "", "");
+      for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        filter->Add(it.Key());
+      }
+    }
+  }
+  unique_lock<shared_mutex> pages_lock = LockPages();
+  key_filter_ = std::move(filter);
+  key_filter_version_ = version;
+}
+
+const KeyFilter *DMMTrie::GetKeyFilter() const { return key_filter_.get(); }
+
+void DMMTrie::EnableCompressedCache(size_t max_bytes) {
+  WaitForCommit();
+  unique_lock<shared_mutex> pages_lock = LockPages();
+  auto tier = make_unique<CompressedCache>(max_bytes);
+  lru_cache_.SetSecondTier(tier.get());
+  compressed_cache_ = std::move(tier);  // replaces the tier of an earlier call
+}
+
+const CompressedCache *DMMTrie::GetCompressedCache() const {
+  return compressed_cache_.get();
+}
+
+size_t DMMTrie::GetCacheMemoryUsage() const {
+  return lru_cache_.MemoryUsage();
+}
+
+size_t DMMTrie::GetCacheBudget() const { return lru_cache_.MaxBytes(); }
+
+uint64_t DMMTrie::GetCacheHits() const { return lru_cache_.Hits(); }
+
+uint64_t DMMTrie::GetCacheMisses() const { return lru_cache_.Misses(); }
+
+size_t DMMTrie::GetPinnedMemoryUsage() const {
+  return lru_cache_.PinnedMemoryUsage();
+}
+
+size_t DMMTrie::GetPinnedPageCount() const { return lru_cache_.PinnedSize(); }
+
+bool DMMTrie::MayContain(uint64_t version, string_view key) const {
+  // a key of a version since the filter was built is either in that version
+  // or written by a later commit
+  return key_filter_ == nullptr || version < key_filter_version_ ||
+         version > committed_version_ || key_filter_->MayContain(key);
+}
+
+// the index entry of key when version is the newest committed version and
+// the key is indexed
+const LatestIndex::Entry *DMMTrie::FindLatest(uint64_t version,
+                                              const string &key) const {
+  if (latest_index_ == nullptr || !latest_index_->Published() ||
+      latest_index_->Version() != version) {
+    return nullptr;
+  }
+  return latest_index_->Find(key);
+}
+
+void DMMTrie::PreparePageUpdate(uint64_t version, PageUpdate &update) {
+  const string &pid = update.pid;
+  update.if_exceed = false;
+  // get the latest version number of a page
+  uint64_t page_version = GetPageVersion({0, 0, false, pid}).first;
+  update.pagekey = {version, 0, false, pid};
+  update.old_pagekey = {page_version, 0, false, pid};
+  // load the page into lru cache
+  update.page = GetPage(update.old_pagekey);
+
+  if (update.page == nullptr) {
+    // GetPage returns nullptr means that the pid is new
+    update.page = new BasePage(this, nullptr, pid);
+    // add the newly generated page into cache
+    PutPage(update.pagekey, update.page);
+  }
+
+  update.deltapage = page_store_->GetActiveDeltaPage(pid);
+  DeltaPage *deltapage = update.deltapage;
+
+  // if (2 * it.second.size() + deltapage->GetDeltaPageUpdateCount() >=
+  //     2 * Td_) {
+  // the updates in page is more than the capacity of two deltapages
+  // directly generate a base page
+  if (2 * update.group_count + deltapage->GetDeltaPageUpdateCount() >=
+      Td_) {
+    // 只要跨页了就不行，因为只要版本更新了，就会创建delta page。
+    update.if_exceed = true;
+    if (deltapage->GetDeltaPageUpdateCount() != 0) {
+      PageKey deltapage_pagekey = {version, 0, true, pid};
+
+      DeltaPage *deltapage_copy = new DeltaPage(*deltapage);
+      deltapage_copy->SetPageKey(deltapage_pagekey);
+      deltapage_copy->SerializeTo();
+      // store frozen deltapage in cache
+      WritePageCache(deltapage_pagekey, deltapage_copy);
+
+      deltapage->ClearDeltaPage();  // delete all DeltaItems in DeltaPage
+      // record the PageKey of DeltaPage passed to LSVPS
+      deltapage->SetLastPageKey(deltapage_pagekey);
+      AddDeltaPageVersion(pid, version);
+    }
+  }
+
+  // the child pages were updated earlier in this commit and hand their root
+  // hashes up, the leaf locations come from WriteLeafValues
+  const PageUpdate *child = update.children;
+  for (size_t i = 0; i < update.group_count; i++) {
+    if (!update.groups[i].IsLeaf()) {  // indexnode + indexnode
+      update.hashes[i] = child->root_hash;
+      child++;
+    }
+  }
+}
+
+void DMMTrie::ApplyPageUpdate(uint64_t version, PageUpdate &update) {
+  DeltaPage *deltapage = update.if_exceed ? nullptr : update.deltapage;
+  for (size_t i = 0; i < update.group_count; i++) {
+    update.page->UpdatePage(version, update.locations[i],
+                            update.groups[i].nibbles(), update.hashes[i],
+                            deltapage, update.pagekey);
+  }
+  update.page->FinalizePage(version, deltapage, update.pagekey);
+  update.root_hash = update.page->GetRoot()->GetHash();
+}
+
+void DMMTrie::FinishPageUpdate(uint64_t version, PageUpdate &update) {
+  const PageKey &pagekey = update.pagekey;
+  DeltaPage *deltapage = update.deltapage;
+  if (update.if_exceed) {
+    BasePage *basepage_copy = new BasePage(*update.page);
+    basepage_copy->SerializeTo();
+    WritePageCache(pagekey, basepage_copy);  // store basepage in cache
+
+    UpdatePageVersion(pagekey, version, version);
+    deltapage->ClearBasePageUpdateCount();
+    deltapage->SetLastPageKey(pagekey);
+  }
+  if (deltapage->GetDeltaPageUpdateCount() != 0) {
+    // 不管满没满，delta page的内容都刷入storage
+    PageKey deltapage_pagekey = {version, 0, true, pagekey.pid};
+
+    DeltaPage *deltapage_copy = new DeltaPage(*deltapage);
+    deltapage_copy->SetPageKey(deltapage_pagekey);
+    deltapage_copy->SerializeTo();
+    // store frozen deltapage in cache
+    WritePageCache(deltapage_pagekey, deltapage_copy);
+
+    deltapage->ClearDeltaPage();  // delete all DeltaItems in DeltaPage
+    // record the PageKey of DeltaPage passed to LSVPS
+    deltapage->SetLastPageKey(deltapage_pagekey);
+    AddDeltaPageVersion(pagekey.pid, version);
+  }
+  UpdatePageKey(update.old_pagekey, pagekey);
+  // deltapage->SerializeTo();
+  page_store_->StoreActiveDeltaPage(deltapage);
+}
+
 string DMMTrie::GetRootHash(uint64_t tid, uint64_t version) {
-  return GetPage({version, tid, false, ""})->GetRoot()->GetHash();
+  ReadGuard guard(this, version);
+  return GetPage({version, tid, false, ""})->GetRoot()->GetHash().ToString();
 }
 
 DMMTrieProof DMMTrie::GetProof(uint64_t tid, uint64_t version,
                                const string &key) {
+  ReadGuard guard(this, version);
   DMMTrieProof merkle_proof;
-  string nibble_path = key;
+  if (!MayContain(version, key)) {
+    merkle_proof.value = "";
+    return merkle_proof;
+  }
+  NibblePath path(key);
+  if (!path.Valid()) {
+    cout << "Key " << key << " not found at version " << version << endl;
+    merkle_proof.value = "";
+    return merkle_proof;
+  }
   uint64_t page_version = version;
   LeafNode *leafnode = nullptr;
-  for (int i = 0; i < key.size() + 1; i += 2) {
-    string pid = nibble_path.substr(0, i);
-    BasePage *page =
-        GetPage({page_version, 0, false, pid});  // false means basepage
+  for (size_t i = 0; i <= path.Size(); i += 2) {
+    BasePage *page = GetPage(path.PageKeyAt(page_version, 0, false, i),
+                             path.Prefix(i));  // false means basepage
     if (page == nullptr || page->GetRoot() == nullptr) {
       cout << "Key " << key << " not found at version " << version << endl;
       merkle_proof.value = "";
       return merkle_proof;
     }
 
-    if (!page->GetRoot()->IsLeaf()) {
-      if (!page->GetRoot()->HasChild(GetIndex(nibble_path[i]))) {
+    Node *root = page->GetRoot();
+    if (!root->IsLeaf()) {
+      if (i >= path.Size() || !root->HasChild(path.Nibble(i))) {
         cout << "Key " << key << " not found at version " << version << endl;
         merkle_proof.value = "";
         return merkle_proof;
       }
       // first level in page is indexnode
-      merkle_proof.proofs.push_back(
-          page->GetRoot()->GetNodeProof(i, GetIndex(nibble_path[i])));
-      if (!page->GetRoot()->GetChild(GetIndex(nibble_path[i]))->IsLeaf()) {
+      merkle_proof.proofs.push_back(root->GetNodeProof(i, path.Nibble(i)));
+      Node *child = root->GetChild(path.Nibble(i));
+      if (!child->IsLeaf()) {
         // second level is indexnode
+        if (i + 1 >= path.Size()) {
+          cout << "Key " << key << " not found at version " << version << endl;
+          merkle_proof.value = "";
+          return merkle_proof;
+        }
         merkle_proof.proofs.push_back(
-            page->GetRoot()
-                ->GetChild(GetIndex(nibble_path[i]))
-                ->GetNodeProof(i + 1, GetIndex(nibble_path[i + 1])));
-        page_version = page->GetRoot()
-                           ->GetChild(GetIndex(nibble_path[i]))
-                           ->GetChildVersion(GetIndex(nibble_path[i + 1]));
+            child->GetNodeProof(i + 1, path.Nibble(i + 1)));
+        page_version = child->GetChildVersion(path.Nibble(i + 1));
       } else {  // second level is leafnode
-        leafnode = static_cast<LeafNode *>(
-            page->GetRoot()->GetChild(GetIndex(nibble_path[i])));
+        leafnode = static_cast<LeafNode *>(child);
       }
     } else {  // first level is leafnode
-      leafnode = static_cast<LeafNode *>(page->GetRoot());
+      leafnode = static_cast<LeafNode *>(root);
     }
   }
   merkle_proof.value = value_store_->ReadValue(leafnode->GetLocation());
@@ -1366,40 +2165,50 @@ DMMTrieProof DMMTrie::GetProof(uint64_t tid, uint64_t version,
 bool DMMTrie::Verify(uint64_t tid, const string &key, const string &value,
                      string root_hash, DMMTrieProof proof) {
   // string hash = HashFunction(key + value);
-  string hash = HashFunction(value);
+  Digest hash = HashDigest(value.data(), value.size());
+  char concatenated_hash[DMM_NODE_FANOUT * HASH_SIZE];
   for (const auto &node_proof : proof.proofs) {
-    string concatenated_hash;
+    size_t size = 0;
     for (int i = 0; i < DMM_NODE_FANOUT; i++) {
-      if (i == node_proof.index) {
-        concatenated_hash += hash;
-      } else {
-        concatenated_hash += node_proof.sibling_hash[i];
+      const Digest &child_hash =
+          i == node_proof.index ? hash : node_proof.sibling_hash[i];
+      if (!child_hash.IsEmpty()) {
+        memcpy(concatenated_hash + size, child_hash.data(), HASH_SIZE);
+        size += HASH_SIZE;
       }
     }
-    hash = HashFunction(concatenated_hash);
+    hash = HashDigest(concatenated_hash, size);
   }
-  return hash == root_hash;
+  return hash.ToString() == root_hash;
 }
 
 bool DMMTrie::Verify(uint64_t tid, uint64_t version, string root_hash) {
-  return RecursiveVerify({version, tid, false, ""}) == root_hash;
+  ReadGuard guard(this, version);
+  return RecursiveVerify({version, tid, false, ""}).ToString() == root_hash;
 }
 
-string DMMTrie::RecursiveVerify(PageKey pagekey) {
+Digest DMMTrie::RecursiveVerify(PageKey pagekey) {
+  static const char kNibbles[] = "0123456789abcdef";
   BasePage *page = GetPage(pagekey);
   if (page == nullptr) {
-    return "";
+    return Digest();
   }
 
   if (page->GetRoot()->IsLeaf()) {
-    // first level is indexnode
+    // first level is leafnode
     string value = value_store_->ReadValue(
         static_cast<LeafNode *>(page->GetRoot())->GetLocation());
     // return HashFunction(pagekey.pid + value);
-    return HashFunction(value);
+    return value.empty() ? Digest() : HashDigest(value.data(), value.size());
   }
 
-  string concatenated_hash;
+  // the leaf values and the second level indexnodes of the page are
+  // independent of each other, hash them all in one batch
+  string values[DMM_NODE_FANOUT];
+  char buffers[DMM_NODE_FANOUT][DMM_NODE_FANOUT * HASH_SIZE];
+  HashMessage messages[DMM_NODE_FANOUT];
+  Digest digests[DMM_NODE_FANOUT];
+  size_t count = 0;
   for (int i = 0; i < DMM_NODE_FANOUT; i++) {
     if (!page->GetRoot()->HasChild(i)) {
       continue;
@@ -1407,30 +2216,320 @@ string DMMTrie::RecursiveVerify(PageKey pagekey) {
     Node *child = page->GetRoot()->GetChild(i);
     if (!child->IsLeaf()) {
       // second level is indexnode
-      string child_concatenated_hash;
+      size_t size = 0;
       for (int j = 0; j < DMM_NODE_FANOUT; j++) {
         if (!child->HasChild(j)) {
           continue;
         }
-        // call RecusiveVerify to calculate hash in child page
-        child_concatenated_hash +=
-            RecursiveVerify({pagekey.version, pagekey.tid, false,
-                             pagekey.pid + to_string(i) + to_string(j)});
+        // call RecusiveVerify to calculate hash in child page, which was last
+        // updated at the version recorded in the indexnode
+        Digest child_hash =
+            RecursiveVerify({child->GetChildVersion(j), pagekey.tid, false,
+                             pagekey.pid + kNibbles[i] + kNibbles[j]});
+        if (!child_hash.IsEmpty()) {
+          memcpy(buffers[count] + size, child_hash.data(), HASH_SIZE);
+          size += HASH_SIZE;
+        }
       }
-      concatenated_hash += HashFunction(child_concatenated_hash);
+      messages[count] = {buffers[count], size};
+      count++;
     } else {
-      string value = value_store_->ReadValue(
+      values[i] = value_store_->ReadValue(
           static_cast<LeafNode *>(child)->GetLocation());
       // concatenated_hash += HashFunction(pagekey.pid + to_string(i) + value);
-      concatenated_hash += HashFunction(value);
+      if (!values[i].empty()) {
+        messages[count++] = {values[i].data(), values[i].size()};
+      }
+    }
+  }
+  HashBatch(messages, count, digests);
+
+  char concatenated_hash[DMM_NODE_FANOUT * HASH_SIZE];
+  size_t size = 0;
+  for (size_t k = 0; k < count; k++) {
+    if (!digests[k].IsEmpty()) {
+      memcpy(concatenated_hash + size, digests[k].data(), HASH_SIZE);
+      size += HASH_SIZE;
+    }
+  }
+  return HashDigest(concatenated_hash, size);
+}
+
+// keys and values with 32-bit sizes, then the nodes: bitmap, proven and the
+// sibling hashes, whose number follows from the two bitmaps
+void DMMTrieMultiProof::SerializeTo(string &buffer) const {
+  auto append = [&buffer](const void *data, size_t size) {
+    buffer.append(reinterpret_cast<const char *>(data), size);
+  };
+  uint32_t count = keys.size();
+  append(&count, sizeof(count));
+  for (size_t i = 0; i < keys.size(); i++) {
+    uint32_t size = keys[i].size();
+    append(&size, sizeof(size));
+    append(keys[i].data(), size);
+    size = values[i].size();
+    append(&size, sizeof(size));
+    append(values[i].data(), size);
+  }
+  count = nodes.size();
+  append(&count, sizeof(count));
+  for (const MultiProofNode &node : nodes) {
+    append(&node.bitmap, sizeof(node.bitmap));
+    append(&node.proven, sizeof(node.proven));
+    for (const Digest &hash : node.sibling_hash) {
+      append(hash.data(), HASH_SIZE);
     }
   }
-  return HashFunction(concatenated_hash);
 }
 
-void DMMTrie::Flush(uint64_t tid, uint64_t version) { page_store_->Flush(); }
+bool DMMTrieMultiProof::Deserialize(const char *buffer, size_t size) {
+  size_t current_size = 0;
+  auto read = [&](void *data, size_t length) {
+    if (size - current_size < length) {
+      return false;
+    }
+    memcpy(data, buffer + current_size, length);
+    current_size += length;
+    return true;
+  };
+  auto read_string = [&](string &str) {
+    uint32_t length;
+    if (!read(&length, sizeof(length)) || size - current_size < length) {
+      return false;
+    }
+    str.assign(buffer + current_size, length);
+    current_size += length;
+    return true;
+  };
+  uint32_t count;
+  if (!read(&count, sizeof(count))) {
+    return false;
+  }
+  keys.clear();
+  values.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    keys.emplace_back();
+    values.emplace_back();
+    if (!read_string(keys.back()) || !read_string(values.back())) {
+      return false;
+    }
+  }
+  if (!read(&count, sizeof(count))) {
+    return false;
+  }
+  nodes.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    MultiProofNode node;
+    if (!read(&node.bitmap, sizeof(node.bitmap)) ||
+        !read(&node.proven, sizeof(node.proven))) {
+      return false;
+    }
+    int siblings = __builtin_popcount(node.bitmap & ~node.proven);
+    node.sibling_hash.resize(siblings);
+    for (Digest &hash : node.sibling_hash) {
+      if (!read(hash.data(), HASH_SIZE)) {
+        return false;
+      }
+    }
+    nodes.push_back(std::move(node));
+  }
+  return current_size == size;
+}
 
-void DMMTrie::Revert(uint64_t tid, uint64_t version) {}
+DMMTrieMultiProof DMMTrie::GetMultiProof(uint64_t tid, uint64_t version,
+                                         const vector<string> &keys) {
+  ReadGuard guard(this, version);
+  DMMTrieMultiProof proof;
+  for (const string &key : keys) {
+    if (!NibblePath(key).Valid()) {
+      cout << "Key " << key << " not found at version " << version << endl;
+      continue;
+    }
+    string lower = key;  // nibbles sort the same as lower case hex
+    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    proof.keys.push_back(std::move(lower));
+  }
+  sort(proof.keys.begin(), proof.keys.end());
+  proof.keys.erase(unique(proof.keys.begin(), proof.keys.end()),
+                   proof.keys.end());
+  proof.values.assign(proof.keys.size(), "");
+  vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> locations;
+  if (!proof.keys.empty()) {
+    ProvePage(version, 0, proof, 0, proof.keys.size(), locations);
+  }
+  ReadValues(locations, proof.values);
+  return proof;
+}
+
+bool DMMTrie::ProvePage(
+    uint64_t version, size_t depth, DMMTrieMultiProof &proof, size_t begin,
+    size_t end,
+    vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> &locations) {
+  const string &first = proof.keys[begin];
+  NibblePath path(first);
+  BasePage *page = GetPage(path.PageKeyAt(version, 0, false, depth),
+                           path.Prefix(depth));
+  if (page == nullptr || page->GetRoot() == nullptr) {
+    return false;
+  }
+  Node *root = page->GetRoot();
+  if (root->IsLeaf()) {  // proves the single key equal to the pid
+    if (end != begin + 1 || first.size() != depth) {
+      return false;
+    }
+    locations.push_back({static_cast<LeafNode *>(root)->GetLocation(), begin});
+    return true;
+  }
+  ProveNode(root, false, depth, proof, begin, end, locations);
+  return true;
+}
+
+void DMMTrie::ProveNode(
+    Node *node, bool second_level, size_t depth, DMMTrieMultiProof &proof,
+    size_t begin, size_t end,
+    vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> &locations) {
+  size_t index = proof.nodes.size();  // the node precedes its proven children
+  proof.nodes.emplace_back();
+  uint16_t bitmap = 0, proven = 0;
+  vector<Digest> sibling_hash;
+  size_t i = begin;
+  while (i < end && proof.keys[i].size() <= depth) {
+    i++;  // ends at an indexnode, such a key cannot be proven
+  }
+  for (int nibble = 0; nibble < DMM_NODE_FANOUT; nibble++) {
+    size_t j = i;
+    while (j < end && NibbleOf(proof.keys[j][depth]) == nibble) {
+      j++;
+    }
+    Digest hash = node->HasChild(nibble) ? node->GetChildHash(nibble) : Digest();
+    if (hash.IsEmpty()) {  // the keys of this child are absent
+      i = j;
+      continue;
+    }
+    bitmap |= 1 << nibble;
+    bool is_proven = false;
+    if (i < j) {
+      if (second_level) {
+        is_proven = ProvePage(node->GetChildVersion(nibble), depth + 1, proof,
+                              i, j, locations);
+      } else if (!node->GetChild(nibble)->IsLeaf()) {
+        ProveNode(node->GetChild(nibble), true, depth + 1, proof, i, j,
+                  locations);
+        is_proven = true;
+      } else if (j == i + 1 && proof.keys[i].size() == depth + 1) {
+        locations.push_back(
+            {static_cast<LeafNode *>(node->GetChild(nibble))->GetLocation(),
+             i});
+        is_proven = true;
+      }
+    }
+    if (is_proven) {
+      proven |= 1 << nibble;
+    } else {
+      sibling_hash.push_back(hash);
+    }
+    i = j;
+  }
+  proof.nodes[index] = {bitmap, proven, std::move(sibling_hash)};
+}
+
+bool DMMTrie::VerifyMultiProof(uint64_t tid, const string &root_hash,
+                               const DMMTrieMultiProof &proof) {
+  if (proof.values.size() != proof.keys.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < proof.keys.size(); i++) {
+    if (i > 0 && proof.keys[i - 1] >= proof.keys[i]) {
+      return false;  // the nodes are matched to the keys in key order
+    }
+  }
+  if (proof.nodes.empty()) {  // an empty trie holds none of the keys
+    for (const string &value : proof.values) {
+      if (!value.empty()) {
+        return false;
+      }
+    }
+    return root_hash == Digest().ToString();
+  }
+  size_t next = 0;
+  Digest hash;
+  if (!VerifyProofNode(proof, 0, 0, proof.keys.size(), next, hash)) {
+    return false;
+  }
+  return next == proof.nodes.size() && hash.ToString() == root_hash;
+}
+
+bool DMMTrie::VerifyProofNode(const DMMTrieMultiProof &proof, size_t depth,
+                              size_t begin, size_t end, size_t &next,
+                              Digest &hash) {
+  if (next >= proof.nodes.size()) {
+    return false;
+  }
+  const MultiProofNode &node = proof.nodes[next++];
+  if ((node.proven & ~node.bitmap) != 0 ||
+      node.sibling_hash.size() !=
+          size_t(__builtin_popcount(node.bitmap & ~node.proven))) {
+    return false;
+  }
+  char concatenated_hash[DMM_NODE_FANOUT * HASH_SIZE];
+  size_t size = 0, sibling = 0, i = begin;
+  if (i < end && proof.keys[i].size() <= depth) {
+    return false;  // a key that ends at an indexnode has no proof
+  }
+  for (int nibble = 0; nibble < DMM_NODE_FANOUT; nibble++) {
+    size_t j = i;
+    while (j < end && NibbleOf(proof.keys[j][depth]) == nibble) {
+      j++;
+    }
+    Digest child_hash;
+    if (node.proven & (1 << nibble)) {
+      if (i == j) {
+        return false;
+      }
+      if (proof.keys[i].size() == depth + 1) {  // the leaf of keys[i]
+        if (j != i + 1 || proof.values[i].empty()) {
+          return false;
+        }
+        child_hash = HashDigest(proof.values[i].data(), proof.values[i].size());
+      } else if (!VerifyProofNode(proof, depth + 1, i, j, next, child_hash)) {
+        return false;
+      }
+    } else if (node.bitmap & (1 << nibble)) {
+      if (i != j) {
+        return false;  // keys below a child that is not proven
+      }
+      child_hash = node.sibling_hash[sibling++];
+    } else {
+      for (size_t k = i; k < j; k++) {  // the keys of an empty child
+        if (!proof.values[k].empty()) {
+          return false;
+        }
+      }
+    }
+    if (!child_hash.IsEmpty()) {
+      memcpy(concatenated_hash + size, child_hash.data(), HASH_SIZE);
+      size += HASH_SIZE;
+    }
+    i = j;
+  }
+  if (i != end) {
+    return false;  // keys that are not hexadecimal
+  }
+  hash = HashDigest(concatenated_hash, size);
+  return true;
+}
+
+void DMMTrie::Flush(uint64_t tid, uint64_t version) {
+  WaitForCommit();
+  unique_lock<shared_mutex> pages_lock = LockPages();
+  page_store_->Flush();
+  if (key_filter_ != nullptr) {  // persisted next to the index files
+    key_filter_->SaveTo(page_store_->GetIndexFilePath() + kKeyFilterFile,
+                        committed_version_);
+  }
+}
+
+void DMMTrie::Revert(uint64_t tid, uint64_t version) { WaitForCommit(); }
 
 DeltaPage *DMMTrie::GetDeltaPage(const string &pid) {
   auto it = active_deltapages_.find(pid);
@@ -1445,6 +2544,7 @@ DeltaPage *DMMTrie::GetDeltaPage(const string &pid) {
 }
 
 pair<uint64_t, uint64_t> DMMTrie::GetPageVersion(PageKey pagekey) {
+  lock_guard<mutex> lock(commit_mutex_);
   auto it = page_versions_.find(pagekey.pid);
   if (it != page_versions_.end()) {
     return it->second;
@@ -1462,86 +2562,246 @@ PageKey DMMTrie::GetLatestBasePageKey(PageKey pagekey) const {
 
 void DMMTrie::UpdatePageVersion(PageKey pagekey, uint64_t current_version,
                                 uint64_t latest_basepage_version) {
+  lock_guard<mutex> lock(commit_mutex_);
   page_versions_[pagekey.pid] = {current_version, latest_basepage_version};
+  if (latest_basepage_version == current_version) {  // a basepage is stored
+    vector<uint64_t> &versions = basepage_versions_[pagekey.pid];
+    if (versions.empty() || versions.back() != current_version) {
+      versions.push_back(current_version);
+    }
+  }
 }
 
 void DMMTrie::WritePageCache(PageKey pagekey, Page *page) {
+  lock_guard<mutex> lock(commit_mutex_);
   page_cache_[pagekey] = page;
 }
 
 void DMMTrie::AddDeltaPageVersion(const string &pid, uint64_t version) {
+  lock_guard<mutex> lock(commit_mutex_);
   deltapage_versions_[pid].push_back(version);
 }
 
-uint64_t DMMTrie::GetVersionUpperbound(const string &pid, uint64_t version) {
-  if (deltapage_versions_.find(pid) == deltapage_versions_.end()) {
-    return 0;  // no deltapage of this pid
+void DMMTrie::GetReplayVersions(const string &pid, uint64_t version,
+                                uint64_t &base_version,
+                                vector<uint64_t> &delta_versions,
+                                uint64_t &next_version) {
+  lock_guard<mutex> lock(commit_mutex_);
+  base_version = 0;
+  next_version = 0;
+  delta_versions.clear();
+  auto base_it = basepage_versions_.find(pid);
+  if (base_it != basepage_versions_.end()) {
+    const vector<uint64_t> &versions = base_it->second;
+    auto it = upper_bound(versions.begin(), versions.end(), version);
+    if (it != versions.begin()) {
+      base_version = *prev(it);
+    }
+    if (it != versions.end()) {
+      next_version = *it;
+    }
   }
-
-  vector<uint64_t> &versions = deltapage_versions_[pid];
-  auto it = upper_bound(versions.begin(), versions.end(), version);
-  if (it == versions.end()) {
-    // no deltapage has version larger than requested
-    return current_version_;
+  auto delta_it = deltapage_versions_.find(pid);
+  if (delta_it != deltapage_versions_.end()) {
+    const vector<uint64_t> &versions = delta_it->second;
+    auto begin = upper_bound(versions.begin(), versions.end(), base_version);
+    auto end = upper_bound(begin, versions.end(), version);
+    delta_versions.assign(begin, end);
+    if (end != versions.end() && (next_version == 0 || *end < next_version)) {
+      next_version = *end;
+    }
   }
-  return *it;
 }
 
 BasePage *DMMTrie::GetPage(
     const PageKey &pagekey) {  // get a page by its pagekey
-  auto it = lru_cache_.find(pagekey);
-  if (it != lru_cache_.end()) {  // page is in cache
-    // move the accessed page to the front
-    pagekeys_.splice(pagekeys_.begin(), pagekeys_, it->second);
-    it->second = pagekeys_.begin();  // update iterator
-    return it->second->second;
-  }
-  // page is not in cache, fetch it from LSVPS
-  BasePage *page = page_store_->LoadPage(pagekey);
+  return GetPage(PackedPageKey::FromPageKey(pagekey), pagekey.pid);
+}
+
+BasePage *DMMTrie::GetPage(const PackedPageKey &pagekey, string_view pid) {
+  BasePage *cached = lru_cache_.Get(pagekey);
+  if (cached != nullptr) {  // page is in cache
+    return cached;
+  }
+  // page is not in cache, fetch it from the compressed tier or LSVPS
+  PageKey full_pagekey{pagekey.version, pagekey.tid, pagekey.type,
+                       string(pid)};
+  BasePage *page = nullptr;
+  thread_local string buffer;
+  if (compressed_cache_ != nullptr &&
+      compressed_cache_->Take(pagekey, buffer)) {
+    page = new BasePage(this, &buffer[0]);
+  } else {
+    page = page_store_->LoadPage(full_pagekey);
+  }
   if (!page) {  // page is not found in disk
     return nullptr;
   }
   // if (!page->GetRoot()) {  // page is not found in disk
   //   return nullptr;
   // }
-  PutPage(pagekey, page);
-  return page;
+  // another reader may have loaded the page meanwhile
+  return lru_cache_.Insert(pagekey, page);
 }
 
 void DMMTrie::PutPage(const PageKey &pagekey,
-                      BasePage *page) {        // add page to cache
-  if (lru_cache_.size() >= max_cache_size_) {  // cache is full
-    PageKey last_key = pagekeys_.back().first;
-    auto last_iter = lru_cache_.find(last_key);
-    delete last_iter->second->second;  // release memory of basepage
-
-    // remove the page whose pagekey is at the tail of list
-    lru_cache_.erase(last_key);
-    pagekeys_.pop_back();
-  }
-  auto it = lru_cache_.find(pagekey);
-  if (it != lru_cache_.end()) {
-    delete it->second->second;
-    pagekeys_.erase(it->second);
-    lru_cache_.erase(it);
-  }
-  // insert the pair of PageKey and BasePage* to the front
-  pagekeys_.push_front(make_pair(pagekey, page));
-  lru_cache_[pagekey] = pagekeys_.begin();
+                      BasePage *page) {  // add page to cache
+  lru_cache_.Put(PackedPageKey::FromPageKey(pagekey), page);
 }
 
 void DMMTrie::UpdatePageKey(
     const PageKey &old_pagekey,
     const PageKey &new_pagekey) {  // update pagekey in lru cache
-  auto it = lru_cache_.find(old_pagekey);
-  if (it != lru_cache_.end()) {
-    // save the basepage indexed by old pagekey
-    BasePage *basepage = it->second->second;
+  lru_cache_.Rekey(PackedPageKey::FromPageKey(old_pagekey),
+                   PackedPageKey::FromPageKey(new_pagekey));
+}
+
+DMMTrieIterator::DMMTrieIterator(DMMTrie *trie, uint64_t version,
+                                 const string &begin, const string &end)
+    : trie_(trie),
+      version_(version),
+      begin_(begin),
+      end_(end),
+      pos_(0),
+      window_(kMinWindow),
+      bound_(nullptr),
+      inclusive_(false),
+      forward_(true) {}
 
-    pagekeys_.erase(it->second);  // delete old pagekey item
-    lru_cache_.erase(it);
+bool DMMTrieIterator::Valid() const { return pos_ < keys_.size(); }
 
-    pagekeys_.push_front(make_pair(new_pagekey, basepage));
-    lru_cache_[new_pagekey] = pagekeys_.begin();
+void DMMTrieIterator::SeekToFirst() { Seek(begin_); }
+
+void DMMTrieIterator::SeekToLast() {
+  window_ = kMinWindow;
+  Fill(end_, false, false, !end_.empty());
+  pos_ = keys_.empty() ? 0 : keys_.size() - 1;
+}
+
+void DMMTrieIterator::Seek(const string &key) {
+  window_ = kMinWindow;
+  Fill(max(key, begin_), true, true, true);
+  pos_ = 0;
+}
+
+void DMMTrieIterator::Next() {
+  if (!Valid()) {
+    return;
+  }
+  if (++pos_ < keys_.size()) {
+    return;
+  }
+  window_ = forward_ ? min(2 * window_, kMaxWindow) : kMinWindow;
+  Fill(keys_.back(), false, true, true);
+  pos_ = 0;
+}
+
+void DMMTrieIterator::Prev() {
+  if (!Valid()) {
+    return;
+  }
+  if (pos_ > 0) {
+    pos_--;
+    return;
   }
-}
\ No newline at end of file
+  window_ = forward_ ? kMinWindow : min(2 * window_, kMaxWindow);
+  Fill(keys_.front(), false, false, true);
+  pos_ = keys_.empty() ? 0 : keys_.size() - 1;
+}
+
+const string &DMMTrieIterator::Key() const { return keys_[pos_]; }
+
+const string &DMMTrieIterator::Value() const { return values_[pos_]; }
+
+void DMMTrieIterator::Fill(string bound, bool inclusive, bool forward,
+                           bool bounded) {
+  DMMTrie::ReadGuard guard(trie_, version_);
+  bound_ = &bound;
+  inclusive_ = inclusive;
+  forward_ = forward;
+  path_.clear();
+  leaves_.clear();
+  ScanPage(version_, bounded);
+  if (!forward_) {
+    reverse(leaves_.begin(), leaves_.end());
+  }
+  keys_.clear();
+  values_.assign(leaves_.size(), string());
+  vector<pair<tuple<uint64_t, uint64_t, uint64_t>, size_t>> locations;
+  locations.reserve(leaves_.size());
+  for (size_t i = 0; i < leaves_.size(); i++) {
+    keys_.push_back(std::move(leaves_[i].first));
+    locations.push_back({leaves_[i].second, i});
+  }
+  trie_->ReadValues(locations, values_);
+  bound_ = nullptr;
+}
+
+bool DMMTrieIterator::ScanPage(uint64_t page_version, bool bounded) {
+  BasePage *page = trie_->GetPage({page_version, 0, false, path_});
+  if (page == nullptr || page->GetRoot() == nullptr) {
+    return false;
+  }
+  Node *root = page->GetRoot();
+  if (root->IsLeaf()) {  // the page holds the single key equal to its pid
+    return Emit(root, bounded);
+  }
+  return ScanIndex(root, false, bounded);
+}
+
+// visits the children of an indexnode in key order. The children of the
+// first level are nodes of this page, those of the second level are pages
+bool DMMTrieIterator::ScanIndex(Node *node, bool second_level,
+                                bool bounded) {
+  static const char kNibbles[] = "0123456789abcdef";
+  for (int i = 0; i < DMM_NODE_FANOUT; i++) {
+    int index = forward_ ? i : DMM_NODE_FANOUT - 1 - i;
+    if (!node->HasChild(index)) {
+      continue;
+    }
+    path_.push_back(kNibbles[index]);
+    int cmp = bounded ? ComparePath() : (forward_ ? 1 : -1);
+    bool stop = false;
+    if (forward_ ? cmp >= 0 : cmp <= 0) {  // otherwise before the bound
+      if (forward_ ? !end_.empty() && path_ >= end_
+                   : begin_.compare(0, path_.size(), path_) > 0) {
+        stop = true;  // this subtree and all after it are out of the range
+      } else if (second_level) {
+        stop = ScanPage(node->GetChildVersion(index), cmp == 0);
+      } else {
+        Node *child = node->GetChild(index);
+        stop = child->IsLeaf() ? Emit(child, cmp == 0)
+                               : ScanIndex(child, true, cmp == 0);
+      }
+    }
+    path_.pop_back();
+    if (stop) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// the key of a leaf is the path to it
+bool DMMTrieIterator::Emit(Node *leaf, bool bounded) {
+  if (bounded) {
+    int cmp = path_.compare(*bound_);
+    if (forward_ ? cmp < 0 || (cmp == 0 && !inclusive_)
+                 : cmp > 0 || (cmp == 0 && !inclusive_)) {
+      return false;
+    }
+  }
+  if (forward_ ? !end_.empty() && path_ >= end_ : path_ < begin_) {
+    return true;
+  }
+  if (leaf->GetHash().IsEmpty()) {  // deleted key
+    return false;
+  }
+  leaves_.push_back({path_, static_cast<LeafNode *>(leaf)->GetLocation()});
+  return leaves_.size() >= window_;
+}
+
+int DMMTrieIterator::ComparePath() const {
+  int cmp = bound_->compare(0, path_.size(), path_);
+  return cmp < 0 ? 1 : (cmp > 0 ? -1 : 0);
+}
@@ -0,0 +1,327 @@
+#include "Hash.hpp"
+
+#include <openssl/sha.h>
+
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HASH_X86_KERNELS
+#endif
+
+using namespace std;
+
+Digest HashDigest(const char *data, size_t size) {
+  Digest digest;
+  HashPolicy::Hash(data, size, &digest.bytes[0]);
+  return digest;
+}
+
+string HashFunction(const string &input) {
+  Digest digest = HashDigest(input.data(), input.size());
+  return string(digest.data(), HASH_SIZE);
+}
+
+static const uint32_t kSHA1Init[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE,
+                                      0x10325476, 0xC3D2E1F0};
+static constexpr size_t kBlockSize = 64;
+
+// number of 64-byte blocks of a message after SHA-1 padding
+static size_t PaddedBlocks(size_t size) { return (size + 8) / kBlockSize + 1; }
+
+// copy block `block` of the padded message into out
+static void LoadBlock(const HashMessage &message, size_t block,
+                      unsigned char *out) {
+  size_t offset = block * kBlockSize;
+  size_t copy = 0;
+  if (offset < message.size) {
+    copy = min(kBlockSize, message.size - offset);
+    memcpy(out, message.data + offset, copy);
+  }
+  memset(out + copy, 0, kBlockSize - copy);
+  if (message.size >= offset && message.size < offset + kBlockSize) {
+    out[message.size - offset] = 0x80;
+  }
+  if (block + 1 == PaddedBlocks(message.size)) {
+    uint64_t bits = uint64_t(message.size) * 8;
+    for (int i = 0; i < 8; i++) {
+      out[kBlockSize - 1 - i] = uint8_t(bits >> (8 * i));
+    }
+  }
+}
+
+// state is kept as state[word][lane] so the vector kernels can load a whole
+// word of every lane at once
+template <size_t LANES>
+using LaneState = uint32_t[5][LANES];
+
+// feed the messages through LANES independent SHA-1 streams. A lane that
+// finishes its message picks up the next one, so messages of different
+// length keep all lanes busy until the batch runs dry.
+template <size_t LANES, typename Compress>
+static void HashLanes(const HashMessage *messages, size_t count,
+                      Digest *digests, Compress compress) {
+  LaneState<LANES> state;
+  alignas(64) unsigned char blocks[LANES][kBlockSize] = {};
+  size_t message_id[LANES], block_id[LANES], block_count[LANES];
+  bool active[LANES];
+  size_t next = 0, active_lanes = 0;
+
+  auto start_lane = [&](size_t lane) {
+    active[lane] = next < count;
+    if (!active[lane]) return;
+    message_id[lane] = next++;
+    block_id[lane] = 0;
+    block_count[lane] = PaddedBlocks(messages[message_id[lane]].size);
+    for (int w = 0; w < 5; w++) state[w][lane] = kSHA1Init[w];
+    active_lanes++;
+  };
+  for (size_t lane = 0; lane < LANES; lane++) {
+    start_lane(lane);
+  }
+
+  while (active_lanes > 0) {
+    for (size_t lane = 0; lane < LANES; lane++) {
+      if (active[lane]) {
+        LoadBlock(messages[message_id[lane]], block_id[lane], blocks[lane]);
+      }
+    }
+    compress(state, blocks);
+    for (size_t lane = 0; lane < LANES; lane++) {
+      if (!active[lane] || ++block_id[lane] < block_count[lane]) continue;
+      Digest &digest = digests[message_id[lane]];
+      for (int w = 0; w < 5; w++) {
+        uint32_t word = state[w][lane];
+        digest.bytes[4 * w] = uint8_t(word >> 24);
+        digest.bytes[4 * w + 1] = uint8_t(word >> 16);
+        digest.bytes[4 * w + 2] = uint8_t(word >> 8);
+        digest.bytes[4 * w + 3] = uint8_t(word);
+      }
+      active_lanes--;
+      start_lane(lane);
+    }
+  }
+}
+
+#ifdef HASH_X86_KERNELS
+
+__attribute__((target("avx2"))) static inline __m256i Rotl(__m256i x,
+                                                           int bits) {
+  return _mm256_or_si256(_mm256_slli_epi32(x, bits),
+                         _mm256_srli_epi32(x, 32 - bits));
+}
+
+// one SHA-1 block in each of the 8 lanes
+__attribute__((target("avx2"))) static void CompressAVX2(
+    LaneState<8> &state, const unsigned char (*blocks)[kBlockSize]) {
+  const __m256i swap = _mm256_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6,
+      5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m256i w[16];
+  for (int t = 0; t < 16; t++) {
+    uint32_t words[8];
+    for (int lane = 0; lane < 8; lane++) {
+      memcpy(&words[lane], blocks[lane] + 4 * t, sizeof(uint32_t));
+    }
+    w[t] = _mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words)), swap);
+  }
+
+  __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i *>(state[0]));
+  __m256i b = _mm256_loadu_si256(reinterpret_cast<__m256i *>(state[1]));
+  __m256i c = _mm256_loadu_si256(reinterpret_cast<__m256i *>(state[2]));
+  __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i *>(state[3]));
+  __m256i e = _mm256_loadu_si256(reinterpret_cast<__m256i *>(state[4]));
+  const __m256i a0 = a, b0 = b, c0 = c, d0 = d, e0 = e;
+
+  for (int t = 0; t < 80; t++) {
+    __m256i wt;
+    if (t < 16) {
+      wt = w[t];
+    } else {
+      wt = Rotl(_mm256_xor_si256(
+                    _mm256_xor_si256(w[(t - 3) & 15], w[(t - 8) & 15]),
+                    _mm256_xor_si256(w[(t - 14) & 15], w[t & 15])),
+                1);
+      w[t & 15] = wt;
+    }
+    __m256i f, k;
+    if (t < 20) {  // (b & c) | (~b & d)
+      f = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+      k = _mm256_set1_epi32(0x5A827999);
+    } else if (t < 40) {
+      f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+      k = _mm256_set1_epi32(0x6ED9EBA1);
+    } else if (t < 60) {  // (b & c) | (b & d) | (c & d)
+      f = _mm256_or_si256(_mm256_and_si256(b, c),
+                          _mm256_and_si256(d, _mm256_or_si256(b, c)));
+      k = _mm256_set1_epi32(0x8F1BBCDC);
+    } else {
+      f = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+      k = _mm256_set1_epi32(0xCA62C1D6);
+    }
+    __m256i temp = _mm256_add_epi32(
+        _mm256_add_epi32(Rotl(a, 5), f),
+        _mm256_add_epi32(_mm256_add_epi32(e, k), wt));
+    e = d;
+    d = c;
+    c = Rotl(b, 30);
+    b = a;
+    a = temp;
+  }
+
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[0]),
+                      _mm256_add_epi32(a, a0));
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[1]),
+                      _mm256_add_epi32(b, b0));
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[2]),
+                      _mm256_add_epi32(c, c0));
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[3]),
+                      _mm256_add_epi32(d, d0));
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(state[4]),
+                      _mm256_add_epi32(e, e0));
+}
+
+// four rounds on the SHA extensions; FUNC selects the round function and
+// must be a constant
+#define SHANI_ROUNDS(FUNC)                                                  \
+  for (size_t l = 0; l < LANES; l++) {                                      \
+    __m128i e = g == 0 ? _mm_add_epi32(e0[l], w[l][0])                       \
+                       : _mm_sha1nexte_epu32(prev[l], w[l][g & 3]);          \
+    prev[l] = abcd[l];                                                      \
+    abcd[l] = _mm_sha1rnds4_epu32(abcd[l], e, FUNC);                        \
+  }
+
+// one SHA-1 block for each of LANES messages, interleaved so the latency of
+// sha1rnds4 in one stream is hidden behind the other streams
+template <size_t LANES>
+__attribute__((target("sha,sse4.1,ssse3"))) static void CompressSHANI(
+    LaneState<LANES> &state, const unsigned char (*blocks)[kBlockSize]) {
+  const __m128i swap =
+      _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd[LANES], e0[LANES], abcd_save[LANES], prev[LANES], w[LANES][4];
+  for (size_t l = 0; l < LANES; l++) {
+    abcd[l] = _mm_set_epi32(state[0][l], state[1][l], state[2][l],
+                            state[3][l]);
+    e0[l] = _mm_set_epi32(state[4][l], 0, 0, 0);
+    abcd_save[l] = abcd[l];
+    for (int i = 0; i < 4; i++) {
+      w[l][i] = _mm_shuffle_epi8(
+          _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(blocks[l] + 16 * i)),
+          swap);
+    }
+  }
+
+  for (int g = 0; g < 20; g++) {
+    if (g >= 4) {  // message schedule for rounds 4g .. 4g + 3
+      for (size_t l = 0; l < LANES; l++) {
+        w[l][g & 3] = _mm_sha1msg2_epu32(
+            _mm_xor_si128(_mm_sha1msg1_epu32(w[l][g & 3], w[l][(g + 1) & 3]),
+                          w[l][(g + 2) & 3]),
+            w[l][(g + 3) & 3]);
+      }
+    }
+    if (g < 5) {
+      SHANI_ROUNDS(0)
+    } else if (g < 10) {
+      SHANI_ROUNDS(1)
+    } else if (g < 15) {
+      SHANI_ROUNDS(2)
+    } else {
+      SHANI_ROUNDS(3)
+    }
+  }
+
+  for (size_t l = 0; l < LANES; l++) {
+    __m128i e = _mm_sha1nexte_epu32(prev[l], e0[l]);
+    __m128i abcd_out = _mm_add_epi32(abcd[l], abcd_save[l]);
+    state[0][l] = uint32_t(_mm_extract_epi32(abcd_out, 3));
+    state[1][l] = uint32_t(_mm_extract_epi32(abcd_out, 2));
+    state[2][l] = uint32_t(_mm_extract_epi32(abcd_out, 1));
+    state[3][l] = uint32_t(_mm_extract_epi32(abcd_out, 0));
+    state[4][l] = uint32_t(_mm_extract_epi32(e, 3));
+  }
+}
+
+#undef SHANI_ROUNDS
+
+#endif  // HASH_X86_KERNELS
+
+bool HashKernelSupported(HashKernel kernel) {
+  if (kernel != HashKernel::kScalar &&
+      HashPolicy::kAlgorithm != HashAlgorithm::kSHA1) {
+    return false;
+  }
+  switch (kernel) {
+    case HashKernel::kScalar:
+      return true;
+#ifdef HASH_X86_KERNELS
+    case HashKernel::kAVX2:
+      return __builtin_cpu_supports("avx2");
+    case HashKernel::kSHANI:
+      return __builtin_cpu_supports("sha") &&
+             __builtin_cpu_supports("sse4.1");
+#endif
+    default:
+      return false;
+  }
+}
+
+const char *HashKernelName(HashKernel kernel) {
+  switch (kernel) {
+    case HashKernel::kScalar:
+      return "scalar";
+    case HashKernel::kAVX2:
+      return "avx2x8";
+    case HashKernel::kSHANI:
+      return "shanix2";
+  }
+  return "unknown";
+}
+
+HashKernel ActiveHashKernel() {
+  static const HashKernel kernel = [] {
+    if (HashKernelSupported(HashKernel::kAVX2)) return HashKernel::kAVX2;
+    if (HashKernelSupported(HashKernel::kSHANI)) return HashKernel::kSHANI;
+    return HashKernel::kScalar;
+  }();
+  return kernel;
+}
+
+void HashBatch(const HashMessage *messages, size_t count, Digest *digests) {
+  static const bool has_avx2 = HashKernelSupported(HashKernel::kAVX2);
+  static const bool has_shani = HashKernelSupported(HashKernel::kSHANI);
+  // eight lanes only pay off when most of them are filled, small batches go
+  // to the two SHA-NI streams
+  HashKernel kernel = HashKernel::kScalar;
+  if (has_avx2 && (count >= 8 || (count >= 4 && !has_shani))) {
+    kernel = HashKernel::kAVX2;
+  } else if (has_shani && count >= 2) {
+    kernel = HashKernel::kSHANI;
+  }
+  HashBatch(messages, count, digests, kernel);
+}
+
+void HashBatch(const HashMessage *messages, size_t count, Digest *digests,
+               HashKernel kernel) {
+  // a single message gains nothing from lanes
+  if (count == 1 || HashPolicy::kAlgorithm != HashAlgorithm::kSHA1) {
+    kernel = HashKernel::kScalar;
+  }
+  switch (kernel) {
+#ifdef HASH_X86_KERNELS
+    case HashKernel::kAVX2:
+      HashLanes<8>(messages, count, digests, CompressAVX2);
+      return;
+    case HashKernel::kSHANI:
+      HashLanes<2>(messages, count, digests, CompressSHANI<2>);
+      return;
+#endif
+    default:
+      for (size_t i = 0; i < count; i++) {
+        digests[i] = HashDigest(messages[i].data, messages[i].size);
+      }
+      return;
+  }
+}
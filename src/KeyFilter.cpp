@@ -0,0 +1,234 @@
+#include "KeyFilter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+#include "NibblePath.hpp"
+
+static constexpr uint32_t kKeyFilterMagic = 0x464b544c;  // "LTKF"
+
+KeyFilter::KeyFilter(double fp_rate, size_t expected_keys)
+    : fp_rate_(fp_rate),
+      expected_keys_(max<size_t>(expected_keys, 1)),
+      size_(0) {
+  if (!(fp_rate > 0 && fp_rate < 1)) {
+    throw runtime_error("false-positive rate must be in (0, 1)");
+  }
+}
+
+// the murmur3 finalizer
+uint64_t KeyFilter::Mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// FNV-1a over the nibbles, so upper and lower case keys hash the same like
+// they address the same leaf
+uint64_t KeyFilter::HashKey(string_view key) {
+  uint64_t h = PackedPageKey::kHashBasis;
+  for (char ch : key) {
+    h = PackedPageKey::ExtendHash(h, NibbleOf(ch) & 0xff);
+  }
+  return Mix(h);
+}
+
+// false-positive rate of a layer with keys_per_block keys per block on
+// average. The keys of a block follow a Poisson distribution, so crowded
+// blocks make the rate higher than that of a plain Bloom filter
+double KeyFilter::BlockRate(double keys_per_block, uint32_t probes) {
+  const double bits = 64 * kWordsPerBlock;
+  double rate = 0;
+  double p = exp(-keys_per_block);  // probability of j keys in a block
+  for (size_t j = 0; j < 4 * keys_per_block + 64; j++) {
+    if (j > 0) {
+      p *= keys_per_block / j;
+    }
+    rate += p * pow(1 - pow(1 - 1 / bits, double(probes) * j), probes);
+  }
+  return rate;
+}
+
+void KeyFilter::AddLayer() {
+  size_t i = layers_.size();
+  // layer i holds expected_keys * 2^i keys at fp_rate / 2^(i+1), the rates
+  // of all layers sum up to less than fp_rate
+  double rate = fp_rate_ / double(uint64_t(2) << min<size_t>(i, 62));
+  // start from the size of a plain Bloom filter and add bits until the
+  // blocks reach the rate
+  double bits_per_key = -log(rate) / (log(2.0) * log(2.0));
+  Layer layer;
+  layer.capacity = expected_keys_ << min<size_t>(i, 20);
+  layer.size = 0;
+  for (;; bits_per_key += 0.5) {
+    double probes = round(bits_per_key * log(2.0));
+    layer.probes = uint32_t(min(16.0, max(1.0, probes)));
+    if (bits_per_key >= kMaxBitsPerKey ||
+        BlockRate(64 * kWordsPerBlock / bits_per_key, layer.probes) <= rate) {
+      break;
+    }
+  }
+  layer.blocks = max<size_t>(
+      1, size_t(ceil(layer.capacity * bits_per_key / (64 * kWordsPerBlock))));
+  layer.bits.assign(layer.blocks * kWordsPerBlock, 0);
+  layers_.push_back(std::move(layer));
+}
+
+size_t KeyFilter::BlockOf(const Layer &layer, uint64_t hash) {
+  return ((hash >> 32) * layer.blocks >> 32) * kWordsPerBlock;
+}
+
+// the bits inside the block take 9 bits each from a second hash, which is
+// mixed again after every 7 probes
+bool KeyFilter::Probe(const Layer &layer, uint64_t hash) {
+  const uint64_t *block = layer.bits.data() + BlockOf(layer, hash);
+  uint64_t bits = Mix(hash ^ kBitSeed);
+  for (uint32_t i = 0; i < layer.probes; i++) {
+    if (i > 0 && i % 7 == 0) {
+      bits = Mix(bits);
+    }
+    uint32_t bit = bits % (64 * kWordsPerBlock);
+    bits >>= 9;
+    if (!(block[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void KeyFilter::Add(string_view key) {
+  uint64_t hash = HashKey(key);
+  for (const Layer &layer : layers_) {
+    if (Probe(layer, hash)) {  // rewrites of a key do not fill the filter
+      return;
+    }
+  }
+  if (layers_.empty() || layers_.back().size >= layers_.back().capacity) {
+    AddLayer();
+  }
+  Layer &layer = layers_.back();
+  uint64_t *block = layer.bits.data() + BlockOf(layer, hash);
+  uint64_t bits = Mix(hash ^ kBitSeed);
+  for (uint32_t i = 0; i < layer.probes; i++) {
+    if (i > 0 && i % 7 == 0) {
+      bits = Mix(bits);
+    }
+    uint32_t bit = bits % (64 * kWordsPerBlock);
+    bits >>= 9;
+    block[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+  layer.size++;
+  size_++;
+}
+
+bool KeyFilter::MayContain(string_view key) const {
+  uint64_t hash = HashKey(key);
+  for (const Layer &layer : layers_) {
+    if (Probe(layer, hash)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void KeyFilter::SaveTo(const string &filepath, uint64_t version) const {
+  // written to a temporary file first, so a crash keeps the old filter
+  string tmp_path = filepath + ".tmp";
+  ofstream out(tmp_path, ios::binary | ios::trunc);
+  if (!out) {
+    throw runtime_error("Failed to open file for writing: " + tmp_path);
+  }
+  uint64_t layer_count = layers_.size();
+  uint64_t expected_keys = expected_keys_, size = size_;
+  out.write(reinterpret_cast<const char *>(&kKeyFilterMagic),
+            sizeof(kKeyFilterMagic));
+  out.write(reinterpret_cast<const char *>(&version), sizeof(version));
+  out.write(reinterpret_cast<const char *>(&fp_rate_), sizeof(fp_rate_));
+  out.write(reinterpret_cast<const char *>(&expected_keys),
+            sizeof(expected_keys));
+  out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+  out.write(reinterpret_cast<const char *>(&layer_count),
+            sizeof(layer_count));
+  for (const Layer &layer : layers_) {
+    uint64_t header[3] = {layer.blocks, layer.capacity, layer.size};
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(&layer.probes),
+              sizeof(layer.probes));
+    out.write(reinterpret_cast<const char *>(layer.bits.data()),
+              layer.bits.size() * sizeof(uint64_t));
+  }
+  out.close();
+  if (!out || rename(tmp_path.c_str(), filepath.c_str()) != 0) {
+    throw runtime_error("Failed to write key filter: " + filepath);
+  }
+}
+
+bool KeyFilter::LoadFrom(const string &filepath, uint64_t &version) {
+  ifstream in(filepath, ios::binary);
+  if (!in) {
+    return false;
+  }
+  uint32_t magic = 0;
+  uint64_t expected_keys = 0, size = 0, layer_count = 0;
+  double fp_rate = 0;
+  in.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+  in.read(reinterpret_cast<char *>(&version), sizeof(version));
+  in.read(reinterpret_cast<char *>(&fp_rate), sizeof(fp_rate));
+  in.read(reinterpret_cast<char *>(&expected_keys), sizeof(expected_keys));
+  in.read(reinterpret_cast<char *>(&size), sizeof(size));
+  in.read(reinterpret_cast<char *>(&layer_count), sizeof(layer_count));
+  if (!in || magic != kKeyFilterMagic || layer_count > 64) {
+    return false;
+  }
+  vector<Layer> layers(layer_count);
+  for (Layer &layer : layers) {
+    uint64_t header[3];
+    in.read(reinterpret_cast<char *>(header), sizeof(header));
+    in.read(reinterpret_cast<char *>(&layer.probes), sizeof(layer.probes));
+    if (!in || header[0] == 0 || header[0] > (uint64_t(1) << 32)) {
+      return false;
+    }
+    layer.blocks = header[0];
+    layer.capacity = header[1];
+    layer.size = header[2];
+    layer.bits.resize(layer.blocks * kWordsPerBlock);
+    in.read(reinterpret_cast<char *>(layer.bits.data()),
+            layer.bits.size() * sizeof(uint64_t));
+  }
+  if (!in) {
+    return false;
+  }
+  fp_rate_ = fp_rate;
+  expected_keys_ = expected_keys;
+  size_ = size;
+  layers_ = std::move(layers);
+  return true;
+}
+
+double KeyFilter::FalsePositiveRate() const { return fp_rate_; }
+
+double KeyFilter::EstimatedFalsePositiveRate() const {
+  double miss = 1;  // chance that no layer reports a key that was not added
+  for (const Layer &layer : layers_) {
+    miss *= 1 - BlockRate(double(layer.size) / layer.blocks, layer.probes);
+  }
+  return 1 - miss;
+}
+
+size_t KeyFilter::Size() const { return size_; }
+
+size_t KeyFilter::Layers() const { return layers_.size(); }
+
+size_t KeyFilter::MemoryUsage() const {
+  size_t bytes = 0;
+  for (const Layer &layer : layers_) {
+    bytes += layer.bits.capacity() * sizeof(uint64_t);
+  }
+  return bytes;
+}
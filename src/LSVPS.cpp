@@ -5,6 +5,7 @@
 #include <fstream>
 #include <iostream>
 #include <stack>
+#include <thread>
 
 #include "common.hpp"
 
@@ -258,33 +259,56 @@ Page *LSVPS::PageQuery(uint64_t version) {
 如果该版本大于latestbasepage，basepage可以直接取latestbasepage否则就进行pagelookup
 可以保证找到pagekey大于他的（起码有latestbasepage）*/
 BasePage *LSVPS::LoadPage(const PageKey &pagekey) {
+  BasePage *cached = historical_page_cache_.Get(pagekey.pid, pagekey.version);
+  if (cached != nullptr) {
+    return cached;
+  }
+  // the pages of the memtable stay valid until the lock is released
+  std::shared_lock<std::shared_mutex> lock = ShareStore();
+  // a page of an earlier version saves replaying the deltas before it
+  uint64_t floor_version = 0;
+  BasePage *floor_page = historical_page_cache_.GetFloor(
+      pagekey.pid, pagekey.version, floor_version);
   std::stack<const DeltaPage *> delta_pages;
   BasePage *basepage;
   PageKey current_pagekey;
-  auto delta_pagekey = pagekey;
-  delta_pagekey.type = true;  // set to delta
-  const DeltaPage *active_deltapage = GetActiveDeltaPage(pagekey.pid);
+  uint64_t next_version = HistoricalPageCache::kOpenVersion;
+  std::unique_ptr<DeltaPage> active_deltapage;
   /*pid足够了 因为一个LSVPS绑定一个trie也就绑定一个tid*/
-  delta_pages.push(active_deltapage);
   /*由于目前不用遍历文件了 所以这里由大于号改成了大于等于号 并且由于batch
    * size扩大的要求 导致必须包含等于号*/
   if (pagekey.version >= trie_->GetLatestBasePageKey(pagekey).version) {
+    {
+      std::lock_guard<std::mutex> active_lock(active_mutex_);
+      active_deltapage =
+          std::make_unique<DeltaPage>(*GetActiveDeltaPage(pagekey.pid));
+    }
+    delta_pages.push(active_deltapage.get());
     current_pagekey = active_deltapage->GetLastPageKey();
   } else {
-    uint64_t replay_version =
-        trie_->GetVersionUpperbound(pagekey.pid, pagekey.version);
-    delta_pagekey.version = replay_version;
-    // WARNING: 这个page有可能被flush所释放掉。
-    DeltaPage *replay_sentinel =
-        dynamic_cast<DeltaPage *>(pageLookup(delta_pagekey));
-    if (replay_sentinel != nullptr) {
-      delta_pages.push(replay_sentinel);
-      current_pagekey = replay_sentinel->GetLastPageKey();
-    } else {
-      current_pagekey = active_deltapage->GetLastPageKey();
+    // replay from the newest basepage not after the version. The chain of a
+    // later deltapage may end at a basepage newer than the version
+    uint64_t base_version;
+    std::vector<uint64_t> delta_versions;
+    trie_->GetReplayVersions(pagekey.pid, pagekey.version, base_version,
+                             delta_versions, next_version);
+    if (next_version == 0) {
+      next_version = HistoricalPageCache::kOpenVersion;
     }
+    for (auto it = delta_versions.rbegin();
+         it != delta_versions.rend() && *it > floor_version; ++it) {
+      // WARNING: 这个page有可能被flush所释放掉。
+      DeltaPage *delta_page = dynamic_cast<DeltaPage *>(
+          pageLookup(PageKey{*it, 0, true, pagekey.pid}));
+      if (delta_page == nullptr) {
+        throw std::runtime_error("DeltaPage not found for pid " +
+                                 pagekey.pid);
+      }
+      delta_pages.push(delta_page);
+    }
+    current_pagekey = PageKey{base_version, 0, false, pagekey.pid};
   }
-  while (current_pagekey.type) {
+  while (current_pagekey.type && current_pagekey.version > floor_version) {
     // WARNING: 这个page有可能被flush所释放掉。
     DeltaPage *delta_page = dynamic_cast<DeltaPage *>(
         pageLookup(current_pagekey));  // precisely search
@@ -295,9 +319,13 @@ BasePage *LSVPS::LoadPage(const PageKey &pagekey) {
       break;
     }
   }
-  if (current_pagekey.version == 0)
+  if (floor_page != nullptr && current_pagekey.version <= floor_version) {
+    basepage = floor_page;  // newer than the page the replay would start from
+  } else if (current_pagekey.version == 0) {
+    delete floor_page;
     basepage = new BasePage(trie_, nullptr, pagekey.pid);
-  else {
+  } else {
+    delete floor_page;
     // WARNING: 这个page有可能被flush所释放掉。
     basepage = dynamic_cast<BasePage *>(pageLookup(current_pagekey));
     // TODO: leak here, basepage is not deleted but overwritten by new
@@ -308,18 +336,33 @@ BasePage *LSVPS::LoadPage(const PageKey &pagekey) {
     }
     basepage = new BasePage(*basepage);  // deep copy
   }
+  uint64_t cost = 1;  // pages and delta items read to rebuild the page
+  uint64_t start_version = basepage->GetPageKey().version;
   while (!delta_pages.empty()) {
-    applyDelta(basepage, delta_pages.top(), pagekey);
+    // deltapages are replayed oldest first, so the first skipped item is the
+    // next change of the page
+    next_version =
+        std::min(next_version, applyDelta(basepage, delta_pages.top(),
+                                          pagekey, start_version, cost));
     delta_pages.pop();
     // TODO: leak here, the poped deltapage is not freed
   }
-  if (basepage->GetPageKey().version < pagekey.version) {
-    // TODO: 拿到的版本比要的版本小 不是有可能最新版本就是比这个版本小吗？
-    std::cerr << "Error: Requested version " << pagekey.version
-              << " not found. Latest available version is "
-              << basepage->GetPageKey().version << std::endl;
+  // a page last changed before the requested version is still the page at
+  // that version, only an empty page means the pid did not exist yet
+  if (basepage->GetRoot() == nullptr &&
+      basepage->GetPageKey().version < pagekey.version) {
+    delete basepage;
     return nullptr;  // the version is not found
   }
+  // only pages that changed again later are kept, the newest page of a pid
+  // stays in the page cache of the trie. A page newer than the requested
+  // version cannot be reused for it, and an empty page is not worth keeping
+  if (next_version != HistoricalPageCache::kOpenVersion &&
+      basepage->GetRoot() != nullptr &&
+      basepage->GetPageKey().version <= pagekey.version) {
+    historical_page_cache_.Store(pagekey.pid, basepage->GetPageKey().version,
+                                 next_version, basepage, cost);
+  }
   return basepage;
 }
 
@@ -332,13 +375,42 @@ void LSVPS::StorePage(Page *page) {
     page_copy = new BasePage(*dynamic_cast<BasePage *>(page));
   }
 
+  std::unique_lock<std::shared_mutex> lock = LockStore();
   table_.Store(page_copy);
   if (table_.IsFull()) {
-    table_.Flush();
+    table_.FlushFull();
+  }
+}
+
+std::unique_lock<std::shared_mutex> LSVPS::LockStore() {
+  writer_waiting_.store(true, std::memory_order_release);
+  std::unique_lock<std::shared_mutex> lock(store_mutex_);
+  writer_waiting_.store(false, std::memory_order_release);
+  return lock;
+}
+
+std::shared_lock<std::shared_mutex> LSVPS::ShareStore() {
+  while (writer_waiting_.load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  return std::shared_lock<std::shared_mutex>(store_mutex_);
+}
+
+void LSVPS::AdoptPage(Page *page) {
+  std::unique_lock<std::shared_mutex> lock = LockStore();
+  table_.Store(page);
+}
+
+void LSVPS::FlushTableIfFull() {
+  std::unique_lock<std::shared_mutex> lock = LockStore();
+  if (table_.IsFull()) {
+    table_.FlushFull();
   }
 }
 
 void LSVPS::Flush() {
+  std::unique_lock<std::shared_mutex> lock = LockStore();
+  std::lock_guard<std::mutex> active_lock(active_mutex_);
   std::cout << "flush memtable..." << std::endl;
   table_.Flush();
   std::cout << "flush delta pages..." << std::endl;
@@ -355,6 +427,8 @@ const std::vector<Page *> &LSVPS::GetTable() const {
 
 int LSVPS::GetNumOfIndexFile() { return index_files_.size(); }
 
+const std::string &LSVPS::GetIndexFilePath() const { return index_file_path_; }
+
 void LSVPS::RegisterTrie(DMMTrie *DMM_trie) { trie_ = DMM_trie; }
 
 Page *LSVPS::pageLookup(const PageKey &pagekey) {
@@ -486,12 +560,21 @@ Page *LSVPS::readPageFromIndexFile(
   return page;
 }
 
-void LSVPS::applyDelta(BasePage *basepage, const DeltaPage *deltapage,
-                       PageKey pagekey) {
+uint64_t LSVPS::applyDelta(BasePage *basepage, const DeltaPage *deltapage,
+                           PageKey pagekey, uint64_t start_version,
+                           uint64_t &cost) {
+  cost++;
   for (auto const &deltapage_item : deltapage->GetDeltaItems()) {
-    if (deltapage_item.version > pagekey.version) break;
+    if (deltapage_item.version <= start_version) {
+      continue;  // already in the page the replay started from
+    }
+    if (deltapage_item.version > pagekey.version) {
+      return deltapage_item.version;
+    }
     basepage->UpdateDeltaItem(deltapage_item);
+    cost++;
   }
+  return HistoricalPageCache::kOpenVersion;
 }
 
 // MemIndexTable实现
@@ -513,8 +596,19 @@ bool LSVPS::MemIndexTable::IsFull() const {
 }
 
 void LSVPS::MemIndexTable::Flush() {
-  if (buffer_.empty()) return;
+  while (!buffer_.empty()) {
+    flushChunk(std::min(buffer_.size(), max_size_));
+  }
+}
+
+void LSVPS::MemIndexTable::FlushFull() {
+  while (IsFull()) {
+    flushChunk(max_size_);
+  }
+}
 
+// writes the oldest count pages to one index file
+void LSVPS::MemIndexTable::flushChunk(size_t count) {
   const std::string dir_path = parent_LSVPS_.index_file_path_ + "/IndexFile";
   if (!std::filesystem::exists(dir_path)) {
     std::filesystem::create_directory(dir_path);
@@ -523,18 +617,20 @@ void LSVPS::MemIndexTable::Flush() {
                          std::to_string(parent_LSVPS_.GetNumOfIndexFile()) +
                          ".dat";
 
-  writeToStorage(filepath);
+  writeToStorage(filepath, count);
 
   parent_LSVPS_.AddIndexFile(
-      {buffer_.front()->GetPageKey(), buffer_.back()->GetPageKey(), filepath});
+      {buffer_.front()->GetPageKey(), buffer_[count - 1]->GetPageKey(),
+       filepath});
 
-  for (auto page : buffer_) {
-    delete page;
+  for (size_t i = 0; i < count; i++) {
+    delete buffer_[i];
   }
-  buffer_.clear();
+  buffer_.erase(buffer_.begin(), buffer_.begin() + count);
 }
 
-void LSVPS::MemIndexTable::writeToStorage(const fs::path &filepath) {
+void LSVPS::MemIndexTable::writeToStorage(const fs::path &filepath,
+                                          size_t count) {
   std::ofstream outFile(filepath, std::ios::binary);
   if (!outFile) {
     throw std::runtime_error("Failed to open file for writing: " +
@@ -546,7 +642,8 @@ void LSVPS::MemIndexTable::writeToStorage(const fs::path &filepath) {
     IndexBlock current_block;
     uint64_t current_location = 0;
     // 写入页面数据
-    for (const auto &page : buffer_) {
+    for (size_t i = 0; i < count; i++) {
+      Page *page = buffer_[i];
       if (!page || !page->GetData()) {
         throw std::runtime_error("Invalid page data encountered");
       }
@@ -744,10 +841,22 @@ void LSVPS::ActiveDeltaPageCache::writePageToDisk(const string &pid,
   }
 }
 
+void LSVPS::ActiveDeltaPageCache::Pin(const string &pid) {
+  pinned_.insert(pid);
+}
+
+void LSVPS::ActiveDeltaPageCache::UnpinAll() { pinned_.clear(); }
+
 void LSVPS::ActiveDeltaPageCache::evictIfNeeded() {
   while (cache_.size() >= max_size_) {
-    // 直接使用begin()获取第一个元素，不需要额外的find操作
+    // 直接使用begin()获取第一个元素，跳过被固定的页面
     auto it = cache_.begin();
+    while (it != cache_.end() && pinned_.count(it->first)) {
+      ++it;
+    }
+    if (it == cache_.end()) {
+      throw std::runtime_error("All active delta pages are pinned");
+    }
     string pid_to_evict = it->first;
     // 写入磁盘
     // writePageToDisk(pid_to_evict, &page_pool_[it->second]);
@@ -919,9 +1028,163 @@ void LSVPS::ActiveDeltaPageCache::FlushToDisk() {
   }
 }
 
+std::unique_ptr<DeltaPage> LSVPS::LoadDeltaPage(const string &pid,
+                                                uint64_t version) {
+  std::shared_lock<std::shared_mutex> lock = ShareStore();
+  PageKey pagekey{version, 0, true, pid};
+  for (const auto &page : table_.GetBuffer()) {
+    if (page->GetPageKey() == pagekey) {  // the buffer keeps its pages
+      return std::make_unique<DeltaPage>(*dynamic_cast<DeltaPage *>(page));
+    }
+  }
+  auto file_iterator = std::find_if(index_files_.begin(), index_files_.end(),
+                                    [&pagekey](const IndexFile &file) {
+                                      return file.min_pagekey <= pagekey &&
+                                             pagekey <= file.max_pagekey;
+                                    });
+  if (file_iterator == index_files_.end()) {
+    return nullptr;
+  }
+  return std::unique_ptr<DeltaPage>(
+      dynamic_cast<DeltaPage *>(readPageFromIndexFile(file_iterator, pagekey)));
+}
+
 void LSVPS::StoreActiveDeltaPage(DeltaPage *page) {
   active_delta_page_cache_.Store(page);
 }
+
+void LSVPS::GetHistoricalPageCacheStats(uint64_t &hits, uint64_t &floor_hits,
+                                        uint64_t &misses) const {
+  hits = historical_page_cache_.Hits();
+  floor_hits = historical_page_cache_.FloorHits();
+  misses = historical_page_cache_.Misses();
+}
+
+LSVPS::HistoricalPageCache::HistoricalPageCache(size_t max_size)
+    : max_size_(max_size),
+      size_(0),
+      inflation_(0),
+      hits_(0),
+      floor_hits_(0),
+      misses_(0) {}
+
+LSVPS::HistoricalPageCache::~HistoricalPageCache() {
+  for (auto &[pid, pages] : pages_) {
+    for (auto &[first_version, entry] : pages) {
+      delete entry.page;
+    }
+  }
+}
+
+BasePage *LSVPS::HistoricalPageCache::Get(const string &pid,
+                                          uint64_t version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto pid_it = pages_.find(pid);
+  if (pid_it != pages_.end()) {
+    // the page with the largest first_version not after version
+    auto it = pid_it->second.upper_bound(version);
+    if (it != pid_it->second.begin()) {
+      --it;
+      Entry &entry = it->second;
+      if (version < entry.next_version) {
+        touch(pid, it->first, entry);
+        hits_++;
+        // the caller owns and may modify the page it gets
+        return new BasePage(*entry.page);
+      }
+    }
+  }
+  misses_++;
+  return nullptr;
+}
+
+BasePage *LSVPS::HistoricalPageCache::GetFloor(const string &pid,
+                                               uint64_t version,
+                                               uint64_t &first_version) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto pid_it = pages_.find(pid);
+  if (pid_it == pages_.end()) {
+    return nullptr;
+  }
+  auto it = pid_it->second.upper_bound(version);
+  if (it == pid_it->second.begin()) {
+    return nullptr;
+  }
+  --it;
+  touch(pid, it->first, it->second);
+  floor_hits_++;
+  first_version = it->first;
+  return new BasePage(*it->second.page);
+}
+
+void LSVPS::HistoricalPageCache::touch(const string &pid,
+                                       uint64_t first_version, Entry &entry) {
+  queue_.erase({entry.priority, pid, first_version});
+  entry.priority = inflation_ + entry.cost;
+  queue_.insert({entry.priority, pid, first_version});
+}
+
+void LSVPS::HistoricalPageCache::Store(const string &pid,
+                                       uint64_t first_version,
+                                       uint64_t next_version,
+                                       const BasePage *page, uint64_t cost) {
+  if (max_size_ == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &pages = pages_[pid];
+  auto it = pages.find(first_version);
+  if (it != pages.end()) {  // replace the stale copy
+    queue_.erase({it->second.priority, pid, first_version});
+    delete it->second.page;
+    pages.erase(it);
+    size_--;
+  }
+  while (size_ >= max_size_) {
+    evict();
+  }
+  // evict() may have dropped the map of pid
+  Entry entry{new BasePage(*page), next_version, cost, inflation_ + cost};
+  pages_[pid].emplace(first_version, entry);
+  queue_.insert({entry.priority, pid, first_version});
+  size_++;
+}
+
+void LSVPS::HistoricalPageCache::evict() {
+  auto victim = queue_.begin();
+  const auto &[priority, pid, first_version] = *victim;
+  inflation_ = priority;
+  auto pid_it = pages_.find(pid);
+  auto it = pid_it->second.find(first_version);
+  delete it->second.page;
+  pid_it->second.erase(it);
+  if (pid_it->second.empty()) {
+    pages_.erase(pid_it);
+  }
+  queue_.erase(victim);
+  size_--;
+}
+
+uint64_t LSVPS::HistoricalPageCache::Hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+uint64_t LSVPS::HistoricalPageCache::FloorHits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return floor_hits_;
+}
+
+uint64_t LSVPS::HistoricalPageCache::Misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+void LSVPS::PinActiveDeltaPage(const string &pid) {
+  active_delta_page_cache_.Pin(pid);
+}
+
+void LSVPS::UnpinActiveDeltaPages() { active_delta_page_cache_.UnpinAll(); }
+
 DeltaPage *LSVPS::GetActiveDeltaPage(const string &pid) {
   DeltaPage *page = active_delta_page_cache_.Get(pid);
   // if (page == nullptr) {
@@ -0,0 +1,137 @@
+#include "LatestIndex.hpp"
+
+#include <algorithm>
+
+#include "NibblePath.hpp"
+
+LatestIndex::LatestIndex(size_t max_bytes)
+    : max_bytes_(max_bytes),
+      size_(0),
+      skipped_(0),
+      version_(0),
+      published_(false) {}
+
+// keys are hashed and compared by nibble, so upper and lower case spellings
+// of a key share one entry like they share one leaf
+static uint64_t HashKey(string_view key) {
+  uint64_t h = PackedPageKey::kHashBasis;
+  for (char ch : key) {
+    h = PackedPageKey::ExtendHash(h, NibbleOf(ch) & 0xff);
+  }
+  return h;
+}
+
+static bool SameKey(const char *stored, string_view key) {
+  for (size_t i = 0; i < key.size(); i++) {
+    if (NibbleOf(stored[i]) != NibbleOf(key[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// linear probing, returns the slot of key or the empty slot it belongs to
+size_t LatestIndex::FindSlot(string_view key, uint64_t key_hash) const {
+  size_t mask = slots_.size() - 1;
+  for (size_t i = key_hash & mask;; i = (i + 1) & mask) {
+    const Slot &slot = slots_[i];
+    if (!slot.used) {
+      return i;
+    }
+    if (slot.key_hash == key_hash && slot.key_size == key.size() &&
+        SameKey(keys_.data() + slot.key_offset, key)) {
+      return i;
+    }
+  }
+}
+
+// doubles the table, fails when that would exceed the byte budget
+bool LatestIndex::Grow() {
+  size_t new_size = slots_.empty() ? kInitialSlots : 2 * slots_.size();
+  if (max_bytes_ != 0 &&
+      new_size * sizeof(Slot) + keys_.capacity() > max_bytes_) {
+    return false;
+  }
+  vector<Slot> old_slots(new_size);
+  old_slots.swap(slots_);
+  size_t mask = slots_.size() - 1;
+  for (const Slot &slot : old_slots) {
+    if (!slot.used) {
+      continue;
+    }
+    size_t i = slot.key_hash & mask;
+    while (slots_[i].used) {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = slot;
+  }
+  return true;
+}
+
+void LatestIndex::Update(uint64_t version, string_view key,
+                         const tuple<uint64_t, uint64_t, uint64_t> &location,
+                         const Digest &value_hash) {
+  published_ = false;
+  uint64_t key_hash = HashKey(key);
+  if (!slots_.empty()) {
+    Slot &slot = slots_[FindSlot(key, key_hash)];
+    if (slot.used) {  // indexed keys are always updated
+      slot.entry = {version, location, value_hash};
+      return;
+    }
+  }
+  // keep the load factor below 3/4
+  if (4 * (size_ + 1) > 3 * slots_.size() && !Grow()) {
+    skipped_++;
+    return;
+  }
+  if (keys_.size() + key.size() > keys_.capacity()) {
+    // grow the key arena ourselves so its capacity stays within the budget
+    size_t capacity = max(2 * keys_.capacity(), keys_.size() + key.size());
+    if (max_bytes_ != 0 &&
+        slots_.size() * sizeof(Slot) + capacity > max_bytes_) {
+      capacity = keys_.size() + key.size();
+    }
+    if (max_bytes_ != 0 &&
+        slots_.size() * sizeof(Slot) + capacity > max_bytes_) {
+      skipped_++;
+      return;
+    }
+    keys_.reserve(capacity);
+  }
+  Slot &slot = slots_[FindSlot(key, key_hash)];
+  slot.key_hash = key_hash;
+  slot.key_offset = keys_.size();
+  slot.key_size = key.size();
+  slot.used = true;
+  slot.entry = {version, location, value_hash};
+  keys_.insert(keys_.end(), key.begin(), key.end());
+  size_++;
+}
+
+void LatestIndex::Publish(uint64_t version) {
+  version_ = version;
+  published_ = true;
+}
+
+uint64_t LatestIndex::Version() const { return version_; }
+
+bool LatestIndex::Published() const { return published_; }
+
+const LatestIndex::Entry *LatestIndex::Find(string_view key) const {
+  if (slots_.empty()) {
+    return nullptr;
+  }
+  const Slot &slot = slots_[FindSlot(key, HashKey(key))];
+  return slot.used ? &slot.entry : nullptr;
+}
+
+size_t LatestIndex::Size() const { return size_; }
+
+size_t LatestIndex::Skipped() const { return skipped_; }
+
+size_t LatestIndex::MemoryUsage() const {
+  return slots_.capacity() * sizeof(Slot) + keys_.capacity();
+}
+
+size_t LatestIndex::MaxBytes() const { return max_bytes_; }
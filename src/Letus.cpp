@@ -3,7 +3,9 @@ extern "C" {
 }
 
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "DMMTrie.hpp"
 #include "LSVPS.hpp"
@@ -27,6 +29,16 @@ struct LetusProofPath {
   LetusProofNode* proof_nodes;
   uint64_t proof_size;
 };
+struct LetusIterator {
+  std::unique_ptr<DMMTrieIterator> it;
+  bool failed = false;  // a read threw, the iterator is no longer valid
+};
+
+// the reads throw once a background commit failed (see LetusCommitAsync),
+// exceptions must not cross the C boundary
+static void LogError(const char* call, const std::exception& e) {
+  std::cerr << call << " failed: " << e.what() << std::endl;
+}
 
 struct Letus* OpenLetus(const char* path_c) {
   std::string path(path_c);
@@ -61,7 +73,13 @@ void LetusDelete(Letus* p, uint64_t tid, uint64_t version, const char* key_c) {
 
 char* LetusGet(Letus* p, uint64_t tid, uint64_t version, const char* key_c) {
   std::string key(key_c);
-  std::string value = p->trie->Get(tid, version, key);
+  std::string_view value;
+  try {
+    value = p->trie->GetView(tid, version, key);
+  } catch (const std::exception& e) {
+    LogError("LetusGet", e);
+    return nullptr;
+  }
   size_t value_size = value.size();
   char* value_c = new char[value_size + 1];
   value.copy(value_c, value_size, 0);
@@ -72,18 +90,164 @@ char* LetusGet(Letus* p, uint64_t tid, uint64_t version, const char* key_c) {
   return value_c;
 }
 
+const char* LetusGetView(Letus* p, uint64_t tid, uint64_t version,
+                         const char* key_c, uint64_t* size) {
+  std::string key(key_c);
+  std::string_view value;
+  try {
+    value = p->trie->GetView(tid, version, key);
+  } catch (const std::exception& e) {
+    LogError("LetusGetView", e);
+    *size = 0;
+    return nullptr;
+  }
+  *size = value.size();
+  return value.data() != nullptr ? value.data() : "";  // NULL means failure
+}
+
+bool LetusMultiGet(Letus* p, uint64_t tid, uint64_t version,
+                   const char** keys_c, uint64_t count, char** values) {
+  std::vector<std::string> keys(keys_c, keys_c + count);
+  std::vector<std::string> results;
+  try {
+    results = p->trie->MultiGet(tid, version, keys);
+  } catch (const std::exception& e) {
+    LogError("LetusMultiGet", e);
+    for (uint64_t i = 0; i < count; i++) {
+      values[i] = nullptr;
+    }
+    return false;
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    size_t value_size = results[i].size();
+    values[i] = new char[value_size + 1];
+    results[i].copy(values[i], value_size, 0);
+    values[i][value_size] = '\0';
+  }
+  return true;
+}
+
+void LetusFreeValues(char** values, uint64_t count) {
+  for (uint64_t i = 0; i < count; i++) {
+    delete[] values[i];
+    values[i] = nullptr;
+  }
+}
+
+static char* CopyString(const std::string& str) {
+  char* str_c = new char[str.size() + 1];
+  str.copy(str_c, str.size(), 0);
+  str_c[str.size()] = '\0';
+  return str_c;
+}
+
+LetusIterator* LetusNewIterator(Letus* p, uint64_t tid, uint64_t version,
+                                const char* begin_c, const char* end_c) {
+  LetusIterator* it = new LetusIterator();
+  try {
+    it->it = p->trie->NewIterator(tid, version, begin_c, end_c);
+  } catch (const std::exception& e) {
+    LogError("LetusNewIterator", e);
+    delete it;
+    return nullptr;
+  }
+  return it;
+}
+
+// runs a positioning call of it, a failed read leaves it invalid
+template <typename F>
+static void MoveIterator(LetusIterator* it, const char* call, F move) {
+  if (it == nullptr || it->failed) {
+    return;
+  }
+  try {
+    move(*it->it);
+  } catch (const std::exception& e) {
+    LogError(call, e);
+    it->failed = true;
+  }
+}
+
+bool LetusIteratorValid(LetusIterator* it) {
+  return it != nullptr && !it->failed && it->it->Valid();
+}
+
+void LetusIteratorSeek(LetusIterator* it, const char* key_c) {
+  MoveIterator(it, "LetusIteratorSeek",
+               [key_c](DMMTrieIterator& i) { i.Seek(key_c); });
+}
+
+void LetusIteratorSeekToFirst(LetusIterator* it) {
+  MoveIterator(it, "LetusIteratorSeekToFirst",
+               [](DMMTrieIterator& i) { i.SeekToFirst(); });
+}
+
+void LetusIteratorSeekToLast(LetusIterator* it) {
+  MoveIterator(it, "LetusIteratorSeekToLast",
+               [](DMMTrieIterator& i) { i.SeekToLast(); });
+}
+
+void LetusIteratorNext(LetusIterator* it) {
+  MoveIterator(it, "LetusIteratorNext",
+               [](DMMTrieIterator& i) { i.Next(); });
+}
+
+void LetusIteratorPrev(LetusIterator* it) {
+  MoveIterator(it, "LetusIteratorPrev",
+               [](DMMTrieIterator& i) { i.Prev(); });
+}
+
+char* LetusIteratorKey(LetusIterator* it) {
+  if (!LetusIteratorValid(it)) {
+    return nullptr;
+  }
+  return CopyString(it->it->Key());
+}
+
+char* LetusIteratorValue(LetusIterator* it) {
+  if (!LetusIteratorValid(it)) {
+    return nullptr;
+  }
+  return CopyString(it->it->Value());
+}
+
+void LetusDeleteIterator(LetusIterator* it) { delete it; }
+
 bool LetusRevert(Letus* p, uint64_t tid, uint64_t version) {
   p->trie->Revert(tid, version);
   return true;
 }
 bool LetusCalcRootHash(Letus* p, uint64_t tid, uint64_t version) {
-  p->trie->CalcRootHash(tid, version);
+  try {
+    p->trie->CalcRootHash(tid, version);
+  } catch (const std::exception& e) {
+    LogError("LetusCalcRootHash", e);
+    return false;
+  }
   // [TODO] replace to CalcRootHash
   return true;
 }
 
+// false when the previous background commit failed, the failure of this one
+// is reported by the next commit, LetusGetRootHash or LetusFlush
+bool LetusCommitAsync(Letus* p, uint64_t tid, uint64_t version) {
+  try {
+    p->trie->CommitAsync(tid, version);
+  } catch (const std::exception& e) {
+    LogError("LetusCommitAsync", e);
+    return false;
+  }
+  return true;
+}
+
 char* LetusGetRootHash(Letus* p, uint64_t tid, uint64_t version) {
-  std::string hash = p->trie->GetRootHash(tid, version);
+  std::string hash;
+  try {
+    hash = p->trie->GetRootHash(tid, version);
+  } catch (const std::exception& e) {
+    LogError("LetusGetRootHash", e);
+    return nullptr;
+  }
   size_t hash_size = hash.size();
   char* hash_c = new char[hash_size + 1];
   hash.copy(hash_c, hash_size, 0);
@@ -95,48 +259,68 @@ char* LetusGetRootHash(Letus* p, uint64_t tid, uint64_t version) {
 }
 
 bool LetusFlush(Letus* p, uint64_t tid, uint64_t version) {
-  p->trie->Flush(tid, version);
+  try {
+    p->trie->Flush(tid, version);
+  } catch (const std::exception& e) {
+    LogError("LetusFlush", e);
+    return false;
+  }
   return true;
 }
 
+// binary digest of HASH_SIZE bytes, null terminated for older callers
+static char* CopyDigest(const Digest& digest) {
+  char* hash_c = new char[HASH_SIZE + 1];
+  memcpy(hash_c, digest.data(), HASH_SIZE);
+  hash_c[HASH_SIZE] = '\0';
+  return hash_c;
+}
+
 LetusProofPath* LetusProof(Letus* p, uint64_t tid, uint64_t version,
                            const char* key_c) {
   std::string key(key_c);
-  std::string value = p->trie->Get(tid, version, key);
+  DMMTrieProof proof;
+  try {
+    proof = p->trie->GetProof(tid, version, key);
+  } catch (const std::exception& e) {
+    LogError("LetusProof", e);
+    return nullptr;
+  }
+  const std::string& value = proof.value;
 #ifdef DEBUG
   std::cout << "key: " << key << ", value: " << value << std::endl;
 #endif
 
-  DMMTrieProof proof = p->trie->GetProof(tid, version, key);
   int proof_size = proof.proofs.size();
   LetusProofNode* proof_nodes = new LetusProofNode[proof_size];
 
-  string hash = HashFunction(value);
+  Digest hash =
+      value.empty() ? Digest() : HashDigest(value.data(), value.size());
   for (int i = 0; i < proof_size; ++i) {
     int nibble_size = proof_size - i;
     proof_nodes[i].index = nibble_size - 1;
     proof_nodes[i].is_data = (i == 0);
     proof_nodes[i].key = new char[nibble_size + 1];
     strcpy(proof_nodes[i].key, key.substr(0, nibble_size).c_str());
-    proof_nodes[i].hash = new char[hash.size() + 1];
-    strcpy(proof_nodes[i].hash, hash.c_str());
+    proof_nodes[i].hash = CopyDigest(hash);
     proof_nodes[i].inodes = new LetusINode[DMM_NODE_FANOUT];
     NodeProof& node_proof = proof.proofs[i];
-    string concatenated_hash;
+    char concatenated_hash[DMM_NODE_FANOUT * HASH_SIZE];
+    size_t concatenated_size = 0;
     for (int j = 0; j < DMM_NODE_FANOUT; j++) {
-      if (j == proof.proofs[i].index) {
-        concatenated_hash += hash;
-      } else {
-        concatenated_hash += node_proof.sibling_hash[j];
+      const Digest& child_hash =
+          j == node_proof.index ? hash : node_proof.sibling_hash[j];
+      if (!child_hash.IsEmpty()) {
+        memcpy(concatenated_hash + concatenated_size, child_hash.data(),
+               HASH_SIZE);
+        concatenated_size += HASH_SIZE;
       }
       proof_nodes[i].inodes[j].key = new char[nibble_size + 1];
       strcpy(proof_nodes[i].inodes[j].key, key.substr(0, nibble_size).c_str());
       proof_nodes[i].inodes[j].key[nibble_size - 1] = '0' + j;
-      proof_nodes[i].inodes[j].hash =
-          new char[node_proof.sibling_hash[j].size() + 1];
-      strcpy(proof_nodes[i].inodes[j].hash, node_proof.sibling_hash[j].c_str());
+      proof_nodes[i].inodes[j].hash = CopyDigest(node_proof.sibling_hash[j]);
     }
-    hash = HashFunction(concatenated_hash);
+    hash = HashDigest(concatenated_hash, concatenated_size);
   }
   LetusProofPath* path = new LetusProofPath();
   path->proof_nodes = proof_nodes;
@@ -144,8 +328,37 @@ LetusProofPath* LetusProof(Letus* p, uint64_t tid, uint64_t version,
   return path;
 }
 
+char* LetusMultiProof(Letus* p, uint64_t tid, uint64_t version,
+                      const char** keys_c, uint64_t count, uint64_t* size) {
+  std::vector<std::string> keys(keys_c, keys_c + count);
+  std::string buffer;
+  try {
+    p->trie->GetMultiProof(tid, version, keys).SerializeTo(buffer);
+  } catch (const std::exception& e) {
+    LogError("LetusMultiProof", e);
+    *size = 0;
+    return nullptr;
+  }
+  char* proof_c = new char[buffer.size()];
+  memcpy(proof_c, buffer.data(), buffer.size());
+  *size = buffer.size();
+  return proof_c;
+}
+
+bool LetusVerifyMultiProof(Letus* p, uint64_t tid, const char* root_hash_c,
+                           const char* proof_c, uint64_t size) {
+  DMMTrieMultiProof proof;
+  if (!proof.Deserialize(proof_c, size)) {
+    return false;
+  }
+  return p->trie->VerifyMultiProof(tid, std::string(root_hash_c, HASH_SIZE),
+                                   proof);
+}
+
+void LetusFreeBuffer(char* buffer) { delete[] buffer; }
+
 uint64_t LetusGetProofPathSize(LetusProofPath* path) {
-  return path->proof_size;
+  return path == nullptr ? 0 : path->proof_size;
 }
 bool LetusGetProofNodeIsData(LetusProofPath* path, uint64_t node_index) {
   return path->proof_nodes[node_index].is_data;
@@ -169,4 +382,6 @@ char* LetusGetINodeKey(LetusProofPath* path, uint64_t node_index,
 char* LetusGetINodeHash(LetusProofPath* path, uint64_t node_index,
                         uint64_t inode_index) {
   return path->proof_nodes[node_index].inodes[inode_index].hash;
-}
\ No newline at end of file
+}
+const char* LetusGetHashAlgorithm() { return HashPolicy::kName; }
+uint64_t LetusGetHashSize() { return HASH_SIZE; }
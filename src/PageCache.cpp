@@ -0,0 +1,496 @@
+#include "PageCache.hpp"
+
+#include "CompressedCache.hpp"
+#include "DMMTrie.hpp"
+
+PageTable::PageTable() : slots_(64, Slot{0, 0}), bits_(6), size_(0) {}
+
+uint32_t PageTable::TagOf(const PackedPageKey &key) {
+  uint64_t h = PackedPageKey::Hash{}(key) * 0x9e3779b97f4a7c15ULL;
+  return uint32_t(h >> 32);
+}
+
+// the high bits of the tag are the home slot
+size_t PageTable::SlotOf(const PackedPageKey &key, uint32_t tag) const {
+  size_t mask = slots_.size() - 1;
+  size_t i = tag >> (32 - bits_);
+  while (slots_[i].entry != 0 &&
+         (slots_[i].tag != tag || !(pool_[slots_[i].entry - 1].key == key))) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+CacheEntry *PageTable::Find(const PackedPageKey &key) {
+  uint32_t tag = TagOf(key);
+  size_t i = SlotOf(key, tag);
+  return slots_[i].entry == 0 ? nullptr : &pool_[slots_[i].entry - 1];
+}
+
+CacheEntry *PageTable::Emplace(const PackedPageKey &key) {
+  if ((size_ + 1) * 4 > slots_.size() * 3) {  // load factor 3/4
+    Grow();
+  }
+  uint32_t entry;
+  if (!free_.empty()) {
+    entry = free_.back();
+    free_.pop_back();
+    pool_[entry] = CacheEntry{};
+  } else {
+    entry = uint32_t(pool_.size());
+    pool_.emplace_back();
+  }
+  pool_[entry].key = key;
+  Place(TagOf(key), entry + 1);
+  size_++;
+  return &pool_[entry];
+}
+
+void PageTable::Erase(CacheEntry *entry) {
+  size_t i = SlotOf(entry->key, TagOf(entry->key));
+  free_.push_back(slots_[i].entry - 1);
+  Unplace(i);
+  size_--;
+}
+
+void PageTable::Rekey(CacheEntry *entry, const PackedPageKey &key) {
+  size_t i = SlotOf(entry->key, TagOf(entry->key));
+  uint32_t index = slots_[i].entry;
+  Unplace(i);
+  entry->key = key;
+  Place(TagOf(key), index);
+}
+
+void PageTable::Place(uint32_t tag, uint32_t entry) {
+  size_t mask = slots_.size() - 1;
+  size_t i = tag >> (32 - bits_);
+  while (slots_[i].entry != 0) {
+    i = (i + 1) & mask;
+  }
+  slots_[i] = Slot{tag, entry};
+}
+
+// moves the following slots of the cluster back into the gap when that does
+// not put them before their home slot, so probes never meet a false gap
+void PageTable::Unplace(size_t slot) {
+  size_t mask = slots_.size() - 1;
+  size_t gap = slot;
+  for (size_t i = (slot + 1) & mask; slots_[i].entry != 0;
+       i = (i + 1) & mask) {
+    size_t home = slots_[i].tag >> (32 - bits_);
+    if (((i - home) & mask) >= ((i - gap) & mask)) {
+      slots_[gap] = slots_[i];
+      gap = i;
+    }
+  }
+  slots_[gap] = Slot{0, 0};
+}
+
+void PageTable::Grow() {
+  vector<Slot> old_slots(slots_.size() * 2, Slot{0, 0});
+  old_slots.swap(slots_);
+  bits_++;
+  for (const Slot &slot : old_slots) {
+    if (slot.entry != 0) {
+      Place(slot.tag, slot.entry);
+    }
+  }
+}
+
+PageCache::PageCache(size_t max_bytes, CachePolicyType policy,
+                     size_t pinned_levels, size_t shards)
+    : PageCache(max_bytes,
+                [policy](size_t capacity) {
+                  return NewCachePolicy(policy, capacity);
+                },
+                pinned_levels, shards) {}
+
+PageCache::PageCache(size_t max_bytes, const CachePolicyFactory &policy,
+                     size_t pinned_levels, size_t shards)
+    : max_bytes_(max_bytes),
+      retired_count_(0),
+      pinned_count_(0),
+      pinned_bytes_(0),
+      second_tier_(nullptr) {
+  if (pinned_levels > kMaxPinnedLevels) {
+    throw runtime_error("at most " + to_string(kMaxPinnedLevels) +
+                        " page levels can be pinned");
+  }
+  size_t shard_count = 1;
+  while (shard_count < shards) {
+    shard_count <<= 1;
+  }
+  shard_mask_ = shard_count - 1;
+  shard_bytes_ = max_bytes / shard_count;
+  shards_ = make_unique<Shard[]>(shard_count);
+  for (size_t i = 0; i < shard_count; i++) {
+    shards_[i].policy = policy(shard_bytes_);
+  }
+  // level l has 256^l pids of 2l nibbles, one chunk for the children of each
+  // page of the level above
+  for (size_t level = 0; level < pinned_levels; level++) {
+    size_t chunks = level == 0 ? 1 : size_t(1) << (8 * (level - 1));
+    PinnedLevel chunk_table(new atomic<PinnedChunk *>[chunks]);
+    for (size_t i = 0; i < chunks; i++) {
+      chunk_table[i].store(nullptr, memory_order_relaxed);
+    }
+    pinned_levels_.push_back(std::move(chunk_table));
+  }
+}
+
+PageCache::~PageCache() {
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    shards_[i].index.ForEach([](CacheEntry &entry) {
+      delete entry.page;  // release memory of basepage
+    });
+  }
+  for (size_t level = 0; level < pinned_levels_.size(); level++) {
+    size_t chunks = level == 0 ? 1 : size_t(1) << (8 * (level - 1));
+    for (size_t i = 0; i < chunks; i++) {
+      PinnedChunk *chunk = pinned_levels_[level][i].load();
+      if (chunk == nullptr) {
+        continue;
+      }
+      for (PinnedSlot &slot : *chunk) {
+        delete slot.page.load();
+      }
+      delete chunk;
+    }
+  }
+  ReleaseRetired();
+}
+
+PageCache::Shard &PageCache::ShardOf(const PackedPageKey &key) {
+  // by pid only, so a commit rekeys a page without leaving its shard. The
+  // table uses the high bits of its hash, the low ones are taken here
+  uint64_t h = key.pid_hash * 0xff51afd7ed558ccdULL;
+  return shards_[(h >> 16) & shard_mask_];
+}
+
+bool PageCache::Pinnable(const PackedPageKey &key) const {
+  return !key.type && key.tid == 0 && key.size % 2 == 0 &&
+         key.size / 2 < pinned_levels_.size();
+}
+
+PageCache::PinnedSlot *PageCache::PinnedSlotOf(const PackedPageKey &key,
+                                               bool create) {
+  size_t level = key.size / 2;
+  size_t chunk_id = 0;  // the pid of the parent page
+  for (size_t i = 0; i + 1 < level; i++) {
+    chunk_id = chunk_id << 8 | key.pid[i];
+  }
+  atomic<PinnedChunk *> &chunk_ref = pinned_levels_[level][chunk_id];
+  PinnedChunk *chunk = chunk_ref.load(memory_order_acquire);
+  if (chunk == nullptr) {
+    if (!create) {
+      return nullptr;
+    }
+    chunk = new PinnedChunk();
+    chunk_ref.store(chunk, memory_order_release);
+  }
+  return &(*chunk)[level == 0 ? 0 : key.pid[level - 1]];
+}
+
+void PageCache::Pin(PinnedSlot *slot, const PackedPageKey &key,
+                    BasePage *page) {
+  BasePage *old_page = slot->page.load(memory_order_relaxed);
+  if (old_page != nullptr) {
+    pinned_count_--;
+    pinned_bytes_ -= slot->bytes;
+    if (old_page != page) {
+      PackedPageKey old_key = key;
+      old_key.version = slot->version.load(memory_order_relaxed);
+      if (old_key.version == key.version) {
+        Retire(old_page);
+      } else {  // an older version of the pid, still valid for its key
+        AddToShard(old_key, old_page);
+      }
+    }
+  }
+  slot->bytes = page->MemoryUsage();
+  slot->version.store(key.version, memory_order_relaxed);
+  slot->page.store(page, memory_order_release);
+  pinned_count_++;
+  pinned_bytes_ += slot->bytes;
+}
+
+BasePage *PageCache::Get(const PackedPageKey &key) {
+  if (Pinnable(key)) {
+    PinnedSlot *slot = PinnedSlotOf(key, false);
+    if (slot != nullptr) {
+      BasePage *page = slot->page.load(memory_order_acquire);
+      if (page != nullptr &&
+          slot->version.load(memory_order_relaxed) == key.version) {
+        return page;
+      }
+    }
+  }
+  Shard &shard = ShardOf(key);
+  lock_guard<mutex> lock(shard.shard_mutex);
+  CacheEntry *entry = shard.index.Find(key);
+  if (entry == nullptr) {
+    shard.misses++;
+    return nullptr;
+  }
+  shard.hits++;
+  shard.policy->Access(entry);
+  return entry->page;
+}
+
+BasePage *PageCache::Insert(const PackedPageKey &key, BasePage *page) {
+  if (Pinnable(key)) {
+    // readers only fill free slots, a pinned page is replaced by commits
+    lock_guard<mutex> lock(pinned_mutex_);
+    PinnedSlot *slot = PinnedSlotOf(key, true);
+    BasePage *pinned = slot->page.load(memory_order_relaxed);
+    if (pinned == nullptr) {
+      Pin(slot, key, page);
+      return page;
+    }
+    if (slot->version.load(memory_order_relaxed) == key.version) {
+      delete page;
+      return pinned;
+    }
+  }
+  Shard &shard = ShardOf(key);
+  unique_lock<mutex> lock(shard.shard_mutex);
+  CacheEntry *entry = shard.index.Find(key);
+  if (entry == nullptr) {
+    vector<Victim> victims;
+    Add(shard, key, page);
+    Evict(shard, victims);
+    lock.unlock();
+    Spill(victims);
+    return page;
+  }
+  // another reader loaded the same page first, page was never shared
+  delete page;
+  shard.policy->Access(entry);
+  return entry->page;
+}
+
+void PageCache::Put(const PackedPageKey &key, BasePage *page) {
+  if (second_tier_ != nullptr) {
+    second_tier_->Erase(key);
+  }
+  if (Pinnable(key)) {
+    lock_guard<mutex> lock(pinned_mutex_);
+    BasePage *cached = Take(key);
+    if (cached != nullptr) {
+      Retire(cached);
+    }
+    Pin(PinnedSlotOf(key, true), key, page);
+    return;
+  }
+  Shard &shard = ShardOf(key);
+  vector<Victim> victims;
+  {
+    lock_guard<mutex> lock(shard.shard_mutex);
+    CacheEntry *entry = shard.index.Find(key);
+    if (entry != nullptr) {
+      Remove(shard, entry);
+    }
+    Add(shard, key, page);
+    Evict(shard, victims);
+  }
+  Spill(victims);
+}
+
+void PageCache::Rekey(const PackedPageKey &old_key,
+                      const PackedPageKey &new_key) {
+  if (second_tier_ != nullptr) {
+    // a copy evicted while the commit changed the page may be half updated
+    second_tier_->Erase(old_key);
+    second_tier_->Erase(new_key);
+  }
+  if (Pinnable(new_key)) {
+    // the page of a commit is updated in place in its slot, or pinned when
+    // it was cached in a shard until now
+    lock_guard<mutex> lock(pinned_mutex_);
+    PinnedSlot *slot = PinnedSlotOf(new_key, true);
+    BasePage *pinned = slot->page.load(memory_order_relaxed);
+    uint64_t version = slot->version.load(memory_order_relaxed);
+    BasePage *page = nullptr;
+    if (pinned != nullptr && version == old_key.version) {
+      page = pinned;
+    } else if ((page = Take(old_key)) == nullptr) {
+      // nothing to move, the page of new_key is measured again
+      page = pinned != nullptr && version == new_key.version
+                 ? pinned
+                 : Take(new_key);
+    }
+    if (page != nullptr) {
+      Pin(slot, new_key, page);
+    }
+    return;
+  }
+  Shard &shard = ShardOf(new_key);
+  if (&ShardOf(old_key) != &shard) {  // pids differ
+    BasePage *page = Take(old_key);
+    if (page != nullptr) {
+      Put(new_key, page);
+      return;
+    }
+  }
+  vector<Victim> victims;
+  {
+    lock_guard<mutex> lock(shard.shard_mutex);
+    CacheEntry *old_entry = shard.index.Find(old_key);
+    CacheEntry *new_entry = shard.index.Find(new_key);
+    if (old_entry != nullptr) {
+      if (new_entry != nullptr) {
+        Remove(shard, new_entry);
+      }
+      // the entry keeps its place in the policy
+      shard.index.Rekey(old_entry, new_key);
+      Measure(shard, old_entry);
+      Evict(shard, victims);
+    } else if (new_entry != nullptr) {
+      Measure(shard, new_entry);
+      Evict(shard, victims);
+    }
+  }
+  Spill(victims);
+}
+
+BasePage *PageCache::Take(const PackedPageKey &key) {
+  Shard &shard = ShardOf(key);
+  lock_guard<mutex> lock(shard.shard_mutex);
+  CacheEntry *entry = shard.index.Find(key);
+  if (entry == nullptr) {
+    return nullptr;
+  }
+  BasePage *page = entry->page;
+  shard.policy->Remove(entry);
+  shard.bytes -= entry->bytes;
+  shard.index.Erase(entry);
+  return page;
+}
+
+void PageCache::AddToShard(const PackedPageKey &key, BasePage *page) {
+  Shard &shard = ShardOf(key);
+  vector<Victim> victims;
+  {
+    lock_guard<mutex> lock(shard.shard_mutex);
+    if (shard.index.Find(key) != nullptr) {  // the shard has its own copy
+      Retire(page);
+      return;
+    }
+    Add(shard, key, page);
+    Evict(shard, victims);
+  }
+  Spill(victims);
+}
+
+void PageCache::Add(Shard &shard, const PackedPageKey &key, BasePage *page) {
+  CacheEntry *entry = shard.index.Emplace(key);
+  entry->page = page;
+  entry->bytes = page->MemoryUsage();
+  shard.policy->Insert(entry);
+  shard.bytes += entry->bytes;
+}
+
+void PageCache::Remove(Shard &shard, CacheEntry *entry) {
+  Retire(entry->page);
+  shard.policy->Remove(entry);
+  shard.bytes -= entry->bytes;
+  shard.index.Erase(entry);
+}
+
+void PageCache::Measure(Shard &shard, CacheEntry *entry) {
+  size_t old_bytes = entry->bytes;
+  entry->bytes = entry->page->MemoryUsage();
+  shard.bytes += entry->bytes - old_bytes;
+  shard.policy->Resize(entry, old_bytes);
+}
+
+void PageCache::Evict(Shard &shard, vector<Victim> &victims) {
+  while (shard.bytes > shard_bytes_ && shard.index.Size() > 1) {
+    CacheEntry *entry = shard.policy->Evict();
+    if (entry == nullptr) {
+      break;
+    }
+    if (second_tier_ != nullptr) {
+      victims.emplace_back(entry->key, entry->page);
+    }
+    Retire(entry->page);
+    shard.bytes -= entry->bytes;
+    shard.index.Erase(entry);
+  }
+}
+
+// retired pages are only deleted by ReleaseRetired, which does not run while
+// the caller may still hold a page, so the victims are safe to read here
+void PageCache::Spill(const vector<Victim> &victims) {
+  for (const Victim &victim : victims) {
+    second_tier_->Put(victim.first, victim.second);
+  }
+}
+
+void PageCache::Retire(BasePage *page) {
+  lock_guard<mutex> lock(retired_mutex_);
+  retired_.push_back(page);
+  retired_count_.store(retired_.size(), memory_order_relaxed);
+}
+
+void PageCache::ReleaseRetired() {
+  vector<BasePage *> retired;
+  {
+    lock_guard<mutex> lock(retired_mutex_);
+    retired.swap(retired_);
+    retired_count_.store(0, memory_order_relaxed);
+  }
+  for (BasePage *page : retired) {
+    delete page;
+  }
+}
+
+void PageCache::SetSecondTier(CompressedCache *tier) { second_tier_ = tier; }
+
+size_t PageCache::RetiredCount() const {
+  return retired_count_.load(memory_order_relaxed);
+}
+
+size_t PageCache::Size() const {
+  size_t size = 0;
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    lock_guard<mutex> lock(shards_[i].shard_mutex);
+    size += shards_[i].index.Size();
+  }
+  return size;
+}
+
+size_t PageCache::MemoryUsage() const {
+  size_t bytes = 0;
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    lock_guard<mutex> lock(shards_[i].shard_mutex);
+    bytes += shards_[i].bytes;
+  }
+  return bytes;
+}
+
+size_t PageCache::MaxBytes() const { return max_bytes_; }
+
+size_t PageCache::PinnedSize() const { return pinned_count_.load(); }
+
+size_t PageCache::PinnedMemoryUsage() const { return pinned_bytes_.load(); }
+
+size_t PageCache::PinnedLevels() const { return pinned_levels_.size(); }
+
+uint64_t PageCache::Hits() const {
+  uint64_t hits = 0;
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    lock_guard<mutex> lock(shards_[i].shard_mutex);
+    hits += shards_[i].hits;
+  }
+  return hits;
+}
+
+uint64_t PageCache::Misses() const {
+  uint64_t misses = 0;
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    lock_guard<mutex> lock(shards_[i].shard_mutex);
+    misses += shards_[i].misses;
+  }
+  return misses;
+}
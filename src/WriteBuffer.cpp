@@ -0,0 +1,187 @@
+#include "WriteBuffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+WriteBuffer::WriteBuffer(size_t block_size)
+    : block_size_(block_size),
+      block_index_(0),
+      block_offset_(0),
+      large_bytes_(0),
+      next_seq_(0),
+      sealed_(false) {}
+
+string_view WriteBuffer::Append(string_view data) {
+  if (data.empty()) {
+    return string_view();
+  }
+  if (data.size() > block_size_ / 4) {
+    // large values get their own block so they do not waste the tail of the
+    // shared blocks
+    large_blocks_.emplace_back(new char[data.size()]);
+    memcpy(large_blocks_.back().get(), data.data(), data.size());
+    large_bytes_ += data.size();
+    return string_view(large_blocks_.back().get(), data.size());
+  }
+  if (blocks_.empty() || block_offset_ + data.size() > block_size_) {
+    if (!blocks_.empty()) {
+      block_index_++;
+    }
+    if (block_index_ == blocks_.size()) {
+      blocks_.emplace_back(new char[block_size_]);
+    }
+    block_offset_ = 0;
+  }
+  char *dst = blocks_[block_index_].get() + block_offset_;
+  memcpy(dst, data.data(), data.size());
+  block_offset_ += data.size();
+  return string_view(dst, data.size());
+}
+
+void WriteBuffer::BeginWrite(size_t count) {
+  if (sealed_) {  // a sealed buffer is only read until it is cleared
+    Clear();
+  }
+  entries_.reserve(entries_.size() + count);
+}
+
+void WriteBuffer::Put(string_view key, string_view value) {
+  BeginWrite(1);
+  string_view key_copy = Append(key);
+  string_view value_copy = Append(value);
+  entries_.push_back({key_copy, value_copy, next_seq_++});
+}
+
+void WriteBuffer::Delete(string_view key) { Put(key, string_view()); }
+
+void WriteBuffer::PutBatch(const KeyValueRef *kvs, size_t count) {
+  BeginWrite(count);
+  for (size_t i = 0; i < count; i++) {
+    string_view key_copy = Append(kvs[i].key);
+    string_view value_copy = Append(kvs[i].value);
+    entries_.push_back({key_copy, value_copy, next_seq_++});
+  }
+}
+
+void WriteBuffer::DeleteBatch(const string_view *keys, size_t count) {
+  BeginWrite(count);
+  for (size_t i = 0; i < count; i++) {
+    entries_.push_back({Append(keys[i]), string_view(), next_seq_++});
+  }
+}
+
+void WriteBuffer::AdoptPuts(vector<pair<string, string>> &&kvs) {
+  BeginWrite(kvs.size());
+  adopted_puts_.push_back(std::move(kvs));
+  for (const auto &kv : adopted_puts_.back()) {
+    entries_.push_back({kv.first, kv.second, next_seq_++});
+  }
+}
+
+void WriteBuffer::AdoptDeletes(vector<string> &&keys) {
+  BeginWrite(keys.size());
+  adopted_deletes_.push_back(std::move(keys));
+  for (const auto &key : adopted_deletes_.back()) {
+    entries_.push_back({key, string_view(), next_seq_++});
+  }
+}
+
+void WriteBuffer::BorrowPuts(const KeyValueRef *kvs, size_t count) {
+  BeginWrite(count);
+  for (size_t i = 0; i < count; i++) {
+    entries_.push_back({kvs[i].key, kvs[i].value, next_seq_++});
+  }
+}
+
+void WriteBuffer::BorrowDeletes(const string_view *keys, size_t count) {
+  BeginWrite(count);
+  for (size_t i = 0; i < count; i++) {
+    entries_.push_back({keys[i], string_view(), next_seq_++});
+  }
+}
+
+const vector<WriteBuffer::PageWork> &WriteBuffer::Seal() {
+  if (sealed_) {
+    return pages_;
+  }
+  sealed_ = true;
+
+  // last writer wins: sort by key then write order and keep the last one
+  sort(entries_.begin(), entries_.end(), [](const Entry &a, const Entry &b) {
+    if (a.key != b.key) {
+      return a.key < b.key;
+    }
+    return a.seq < b.seq;
+  });
+  size_t count = 0;
+  for (size_t i = 0; i < entries_.size(); i++) {
+    if (i + 1 < entries_.size() && entries_[i + 1].key == entries_[i].key) {
+      continue;
+    }
+    entries_[count++] = entries_[i];
+  }
+  entries_.resize(count);
+
+  // every key updates the page at each even prefix of it
+  groups_.clear();
+  for (const Entry &entry : entries_) {
+    size_t key_size = entry.key.size();
+    for (size_t i = key_size % 2 == 0 ? key_size : key_size - 1;; i -= 2) {
+      size_t path_size = min(i + 2, key_size);
+      groups_.push_back(
+          {entry.key.substr(0, path_size), static_cast<uint32_t>(i), &entry});
+      if (i == 0) {
+        break;
+      }
+    }
+  }
+  // pids of the same size compare like pid + nibbles, so one comparison on
+  // path orders by pid and then nibbles
+  sort(groups_.begin(), groups_.end(),
+       [](const NibbleGroup &a, const NibbleGroup &b) {
+         if (a.pid_size != b.pid_size) {
+           return a.pid_size > b.pid_size;
+         }
+         return a.path < b.path;
+       });
+  groups_.erase(unique(groups_.begin(), groups_.end(),
+                       [](const NibbleGroup &a, const NibbleGroup &b) {
+                         return a.pid_size == b.pid_size && a.path == b.path;
+                       }),
+                groups_.end());
+
+  pages_.clear();
+  for (size_t i = 0; i < groups_.size(); i++) {
+    if (pages_.empty() || pages_.back().pid != groups_[i].pid()) {
+      pages_.push_back({groups_[i].pid(), &groups_[i], 0});
+    }
+    pages_.back().group_count++;
+  }
+  return pages_;
+}
+
+void WriteBuffer::Clear() {
+  entries_.clear();
+  groups_.clear();
+  pages_.clear();
+  large_blocks_.clear();
+  large_bytes_ = 0;
+  adopted_puts_.clear();
+  adopted_deletes_.clear();
+  block_index_ = 0;
+  block_offset_ = 0;
+  next_seq_ = 0;
+  sealed_ = false;
+}
+
+bool WriteBuffer::Empty() const { return entries_.empty(); }
+
+size_t WriteBuffer::Size() const { return entries_.size(); }
+
+const vector<WriteBuffer::Entry> &WriteBuffer::Entries() const {
+  return entries_;
+}
+
+size_t WriteBuffer::ArenaBytes() const {
+  return blocks_.size() * block_size_ + large_bytes_;
+}
@@ -0,0 +1,296 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <random>
+
+#include "DMMTrie.hpp"
+#include "LSVPS.hpp"
+#include "generator.hpp"
+
+inline char RandomPrintChar(uint64_t num) {
+  static const char charset[] =
+      "0123456789"
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+      "abcdefghijklmnopqrstuvwxyz";
+  return charset[num % (sizeof(charset) - 1)];
+}
+
+std::string BuildKeyName(uint64_t key_num, int key_len) {
+  std::string key_num_str = std::to_string(key_num);
+  int zeros = key_len - key_num_str.length();
+  zeros = std::max(0, zeros);
+  std::string key_name = "";
+  return key_name.append(zeros, '0').append(key_num_str);
+}
+
+double Seconds(std::chrono::system_clock::duration duration) {
+  return double(std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+                    .count()) *
+         std::chrono::nanoseconds::period::num /
+         std::chrono::nanoseconds::period::den;
+}
+
+// hit rate of the basepage cache under a mix of reads of the latest version,
+// skewed towards hot keys, and historical reads of random keys at random old
+// versions, which touch pages that are rarely used again. A historical read
+// is a range scan of scan_len keys, or a Get when scan_len is 0. The cache
+// budget is kept small so the policies have to choose what to evict.
+int main(int argc, char** argv) {
+  uint64_t num_accout = 100000;
+  uint64_t update_count = 50;     // versions after the load
+  uint64_t update_batch = 1000;   // updated keys per version
+  uint64_t num_ops = 100000;      // measured reads, as many warm up the cache
+  uint64_t hist_percent = 50;     // share of historical reads
+  uint64_t scan_len = 16;
+  uint64_t cache_mb = 64;
+  uint64_t compressed_mb = 0;  // budget of the compressed tier, 0 for none
+  uint64_t key_len = 32;
+  uint64_t value_len = 256;
+  CachePolicyType policy = CachePolicyType::kCLOCK;
+  std::string data_path = "data/";
+  std::string index_path = "index";
+  std::string result_path = "exps/results/cache.csv";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "a:t:b:o:h:s:c:z:p:k:v:d:i:r:")) != -1) {
+    char* strtolPtr;
+    switch (opt) {
+      case 'a':  // num_accout
+        num_accout = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (num_accout <= 0)) {
+          std::cerr << "option -a requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 't':  // versions of updates
+        update_count = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (update_count <= 0)) {
+          std::cerr << "option -t requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 'b':  // updates per version
+        update_batch = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (update_batch <= 0)) {
+          std::cerr << "option -b requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 'o':  // number of reads
+        num_ops = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (num_ops <= 0)) {
+          std::cerr << "option -o requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 'h':  // percentage of historical reads
+        hist_percent = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (hist_percent > 100)) {
+          std::cerr << "option -h requires a percentage\n" << std::endl;
+        }
+        break;
+
+      case 's':  // keys per historical scan
+        scan_len = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0')) {
+          std::cerr << "option -s requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 'c':  // cache budget in MB
+        cache_mb = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (cache_mb <= 0)) {
+          std::cerr << "option -c requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 'z':  // compressed tier budget in MB
+        compressed_mb = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0')) {
+          std::cerr << "option -z requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 'p':  // replacement policy
+      {
+        std::string name = optarg;
+        if (name == CachePolicyName(CachePolicyType::kLRU)) {
+          policy = CachePolicyType::kLRU;
+        } else if (name == CachePolicyName(CachePolicyType::k2Q)) {
+          policy = CachePolicyType::k2Q;
+        } else if (name == CachePolicyName(CachePolicyType::kARC)) {
+          policy = CachePolicyType::kARC;
+        } else if (name != CachePolicyName(CachePolicyType::kCLOCK)) {
+          std::cerr << "option -p requires clock, lru, 2q or arc\n"
+                    << std::endl;
+        }
+        break;
+      }
+
+      case 'k':  // length of key.
+        key_len = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (key_len <= 0)) {
+          std::cerr << "option -k requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 'v':  // length of value.
+        value_len = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (value_len <= 0)) {
+          std::cerr << "option -v requires a numeric arg\n" << std::endl;
+        }
+        break;
+
+      case 'd':  // data path
+        data_path = optarg;
+        break;
+
+      case 'i':  // index path
+        index_path = optarg;
+        break;
+
+      case 'r':  // result path
+        result_path = optarg;
+        break;
+
+      default:
+        std::cerr << "Unknown argument " << argv[optind] << std::endl;
+        break;
+    }
+  }
+
+  // init database
+  LSVPS* page_store = new LSVPS(index_path);
+  VDLS* value_store = new VDLS(data_path);
+  DMMTrie* trie = new DMMTrie(0, page_store, value_store, 0, 1,
+                              size_t(cache_mb) << 20, policy);
+  page_store->RegisterTrie(trie);
+  if (compressed_mb > 0) {
+    trie->EnableCompressedCache(size_t(compressed_mb) << 20);
+  }
+
+  // load the accounts, then update random keys so the pages have many
+  // versions
+  key_len += key_len % 2 ? 0 : 1;  // make sure key_len is odd
+  uint64_t version = 1;
+  std::vector<std::pair<std::string, std::string>> batch;
+  batch.reserve(num_accout);
+  for (uint64_t num = 1; num <= num_accout; num++) {
+    batch.emplace_back(BuildKeyName(num, key_len),
+                       std::string(value_len, RandomPrintChar(num)));
+  }
+  trie->PutBatch(0, version, std::move(batch));
+  trie->Commit(version);
+  UniformGenerator update_generator(1, num_accout);
+  for (version = 2; version <= update_count + 1; version++) {
+    batch.clear();
+    for (uint64_t i = 0; i < update_batch; i++) {
+      uint64_t num = update_generator.Next();
+      std::string val(value_len, RandomPrintChar(num + version));
+      batch.emplace_back(BuildKeyName(num, key_len), std::move(val));
+    }
+    trie->PutBatch(0, version, std::move(batch));
+    trie->Commit(version);
+  }
+  uint64_t latest = version - 1;
+  std::cout << "loaded " << num_accout << " accounts, " << latest
+            << " versions" << std::endl;
+
+  // the reads are generated up front so the generators stay out of the
+  // measured time
+  struct Read {
+    bool historical;
+    uint64_t version;
+    std::string key;
+  };
+  std::vector<Read> reads(2 * num_ops);
+  ZipfianGenerator hot_generator(1, num_accout);
+  UniformGenerator cold_generator(1, num_accout);
+  UniformGenerator version_generator(1, std::max<uint64_t>(1, latest - 1));
+  std::mt19937_64 rng(42);
+  for (Read& read : reads) {
+    read.historical = rng() % 100 < hist_percent;
+    if (read.historical) {
+      read.version = version_generator.Next();
+      read.key = BuildKeyName(cold_generator.Next(), key_len);
+    } else {
+      read.version = latest;
+      // scatter the hot keys over the trie like hashed account ids
+      uint64_t rank = hot_generator.Next();
+      read.key = BuildKeyName(rank * 2654435761ULL % num_accout + 1, key_len);
+    }
+  }
+
+  double latest_latency = 0, hist_latency = 0;
+  uint64_t latest_reads = 0, hist_reads = 0;
+  uint64_t hits = 0, misses = 0, compressed_hits = 0;
+  const CompressedCache* compressed = trie->GetCompressedCache();
+  for (uint64_t i = 0; i < reads.size(); i++) {
+    if (i == num_ops) {  // the first half warms up the cache
+      hits = trie->GetCacheHits();
+      misses = trie->GetCacheMisses();
+      compressed_hits = compressed ? compressed->Hits() : 0;
+    }
+    const Read& read = reads[i];
+    auto start = std::chrono::system_clock::now();
+    if (!read.historical) {
+      trie->Get(0, read.version, read.key);
+    } else if (scan_len == 0) {
+      trie->Get(0, read.version, read.key);
+    } else {
+      auto it = trie->NewIterator(0, read.version, read.key, "");
+      it->Seek(read.key);
+      for (uint64_t j = 0; j < scan_len && it->Valid(); j++) {
+        it->Next();
+      }
+    }
+    auto end = std::chrono::system_clock::now();
+    if (i < num_ops) {
+      continue;
+    }
+    if (read.historical) {
+      hist_latency += Seconds(end - start);
+      hist_reads++;
+    } else {
+      latest_latency += Seconds(end - start);
+      latest_reads++;
+    }
+  }
+  hits = trie->GetCacheHits() - hits;
+  misses = trie->GetCacheMisses() - misses;
+  if (compressed) {
+    compressed_hits = compressed->Hits() - compressed_hits;
+  }
+  double hit_rate = double(hits) / std::max<uint64_t>(1, hits + misses);
+  double latest_avg = latest_latency / std::max<uint64_t>(1, latest_reads);
+  double hist_avg = hist_latency / std::max<uint64_t>(1, hist_reads);
+
+  std::cout << "policy " << CachePolicyName(policy) << ", historical "
+            << hist_percent << "%, hit rate:" << hit_rate
+            << ", latest read latency:" << latest_avg
+            << ", historical read latency:" << hist_avg
+            << ", cache bytes:" << trie->GetCacheMemoryUsage()
+            << ", pinned pages:" << trie->GetPinnedPageCount()
+            << ", pinned bytes:" << trie->GetPinnedMemoryUsage() << std::endl;
+  if (compressed) {
+    std::cout << "compressed tier hits:" << compressed_hits
+              << ", pages:" << compressed->Size()
+              << ", bytes:" << compressed->MemoryUsage()
+              << ", serialized bytes:" << compressed->RawBytes() << std::endl;
+  }
+
+  std::ofstream rs_file;
+  rs_file.open(result_path, std::ios::trunc);
+  rs_file << "policy,hist_percent,scan_len,cache_mb,compressed_mb,hits,"
+             "misses,compressed_hits,hit_rate,latest_latency,hist_latency"
+          << std::endl;
+  rs_file << CachePolicyName(policy) << "," << hist_percent << ","
+          << scan_len << "," << cache_mb << "," << compressed_mb << ","
+          << hits << "," << misses << "," << compressed_hits << ","
+          << hit_rate << "," << latest_avg << "," << hist_avg << std::endl;
+  rs_file.close();
+
+  std::cout << "finished" << std::endl;
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Hash.hpp"
+
+// compares the per-call path (HashFunction) with every HashBatch kernel
+// supported by this CPU and hash policy on batches of equally sized messages.
+// The default message size is the concatenation of 16 child digests, i.e. a
+// full indexnode.
+int main(int argc, char** argv) {
+  uint64_t batch_size = 16;
+  uint64_t message_size = 16 * HASH_SIZE;
+  uint64_t num_batch = 100000;
+  std::string result_path = "exps/results/hash.csv";
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:t:r:")) != -1) {
+    switch (opt) {
+      case 'n':  // messages per batch
+      {
+        char* strtolPtr;
+        batch_size = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (batch_size <= 0)) {
+          std::cerr << "option -n requires a numeric arg\n" << std::endl;
+        }
+        break;
+      }
+
+      case 's':  // message size in bytes
+      {
+        char* strtolPtr;
+        message_size = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0')) {
+          std::cerr << "option -s requires a numeric arg\n" << std::endl;
+        }
+        break;
+      }
+
+      case 't':  // number of batches
+      {
+        char* strtolPtr;
+        num_batch = strtoul(optarg, &strtolPtr, 10);
+        if ((*optarg == '\0') || (*strtolPtr != '\0') || (num_batch <= 0)) {
+          std::cerr << "option -t requires a numeric arg\n" << std::endl;
+        }
+        break;
+      }
+
+      case 'r':  // result path
+      {
+        result_path = optarg;
+        break;
+      }
+
+      default:
+        std::cerr << "Unknown argument " << argv[optind] << std::endl;
+        break;
+    }
+  }
+
+  std::vector<std::string> inputs(batch_size);
+  std::vector<HashMessage> messages(batch_size);
+  for (uint64_t i = 0; i < batch_size; i++) {
+    inputs[i].resize(message_size);
+    for (uint64_t j = 0; j < message_size; j++) {
+      inputs[i][j] = char((i * 131 + j * 7) & 0xff);
+    }
+    messages[i] = {inputs[i].data(), inputs[i].size()};
+  }
+
+  std::ofstream rs_file;
+  rs_file.open(result_path, std::ios::trunc);
+  rs_file << "kernel,batch_size,message_size,latency,throughput" << std::endl;
+
+  auto report = [&](const std::string& name, double latency) {
+    double throughput = double(batch_size * num_batch) / latency;
+    std::cout << name << ", latency:" << latency
+              << ", throughput:" << throughput << " msg/s, "
+              << throughput * message_size / (1 << 20) << " MB/s" << std::endl;
+    rs_file << name << "," << batch_size << "," << message_size << ","
+            << latency << "," << throughput << std::endl;
+  };
+
+  std::cout << "hash algorithm: " << HashPolicy::kName << std::endl;
+  // baseline: one call per message returning a std::string
+  std::vector<std::string> expected(batch_size);
+  auto start = std::chrono::system_clock::now();
+  for (uint64_t b = 0; b < num_batch; b++) {
+    for (uint64_t i = 0; i < batch_size; i++) {
+      expected[i] = HashFunction(inputs[i]);
+    }
+  }
+  auto end = std::chrono::system_clock::now();
+  auto duration =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+  report("per-call", double(duration.count()) *
+                         std::chrono::nanoseconds::period::num /
+                         std::chrono::nanoseconds::period::den);
+
+  std::vector<Digest> digests(batch_size);
+  for (HashKernel kernel :
+       {HashKernel::kScalar, HashKernel::kAVX2, HashKernel::kSHANI}) {
+    if (!HashKernelSupported(kernel)) {
+      std::cout << HashKernelName(kernel) << " not supported" << std::endl;
+      continue;
+    }
+    start = std::chrono::system_clock::now();
+    for (uint64_t b = 0; b < num_batch; b++) {
+      HashBatch(messages.data(), batch_size, digests.data(), kernel);
+    }
+    end = std::chrono::system_clock::now();
+    duration =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    report(HashKernelName(kernel), double(duration.count()) *
+                                       std::chrono::nanoseconds::period::num /
+                                       std::chrono::nanoseconds::period::den);
+    for (uint64_t i = 0; i < batch_size; i++) {
+      if (std::string(digests[i].data(), HASH_SIZE) != expected[i]) {
+        std::cerr << HashKernelName(kernel) << " digest mismatch at message "
+                  << i << std::endl;
+        return 1;
+      }
+    }
+  }
+
+  std::cout << "active kernel: " << HashKernelName(ActiveHashKernel())
+            << std::endl;
+  rs_file.close();
+  return 0;
+}
@@ -239,11 +239,8 @@ int main(int argc, char** argv) {
     }
     for (int t = 0; t < int(num_txn_account); t++) {
       std::string key = BuildKeyName(random_keys[t], key_len);
-      std::map<uint64_t, std::vector<std::string>> keys;
       auto start = std::chrono::system_clock::now();
-      for (size_t v = ov; v < lv; ++v) {
-        trie->GetProof(0, v, key);
-      }
+      trie->GetHistory(0, key, ov, lv - 1);
       auto end = std::chrono::system_clock::now();
       auto duration =
           std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
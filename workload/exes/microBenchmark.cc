@@ -141,13 +141,14 @@ int main(int argc, char** argv) {
   CounterGenerator key_generator(1);
   for (; version <= num_load_version; version++) {
     auto start = std::chrono::system_clock::now();
+    std::vector<std::pair<std::string, std::string>> batch;
+    batch.reserve(load_batch_size);
     for (int i = 0; i < int(load_batch_size); i++) {
       uint64_t num = key_generator.Next();
-      std::string key = BuildKeyName(num, key_len);
-      std::string val = "";
-      val = val.append(value_len, RandomPrintChar(num));
-      trie->Put(0, version, key, val);
+      batch.emplace_back(BuildKeyName(num, key_len),
+                         std::string(value_len, RandomPrintChar(num)));
     }
+    trie->PutBatch(0, version, std::move(batch));
     trie->Commit(version);
     auto end = std::chrono::system_clock::now();
     auto duration =
@@ -176,14 +177,15 @@ int main(int argc, char** argv) {
   int txn_key_id = 0;
   for (; version <= num_load_version + num_txn_version; version++) {
     auto start = std::chrono::system_clock::now();
+    std::vector<std::pair<std::string, std::string>> batch;
+    batch.reserve(txn_batch_size);
     for (int i = 0; i < int(txn_batch_size); i++) {
       uint64_t num = random_keys[txn_key_id];
-      std::string key = BuildKeyName(num, key_len);
-      std::string val = "";
-      val = val.append(value_len, RandomPrintChar(num));
-      trie->Put(0, version, key, val);
+      batch.emplace_back(BuildKeyName(num, key_len),
+                         std::string(value_len, RandomPrintChar(num)));
       txn_key_id++;
     }
+    trie->PutBatch(0, version, std::move(batch));
     trie->Commit(version);
     auto end = std::chrono::system_clock::now();
     auto duration =
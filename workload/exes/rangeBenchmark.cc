@@ -190,9 +190,9 @@ int main(int argc, char** argv) {
     int txn_key_id = 0;
       uint64_t num = random_keys[txn_key_id];
       auto start = std::chrono::system_clock::now();
-      for (int ri = 0; ri < r; ri++) {
-        std::string key = BuildKeyName(num + ri, key_len);
-        trie->Get(0, version, key);
+      auto it = trie->NewIterator(0, version, BuildKeyName(num, key_len),
+                                  BuildKeyName(num + r, key_len));
+      for (it->SeekToFirst(); it->Valid(); it->Next()) {
       }
       auto end = std::chrono::system_clock::now();
       auto duration =
@@ -131,11 +131,13 @@ int main(int argc, char** argv) {
   CounterGenerator key_generator(1);
   for (; version <= num_load_version; version++) {
     auto start = chrono::system_clock::now();
+    std::vector<std::pair<std::string, std::string>> batch;
+    batch.reserve(load_batch_size);
     for (int i = 0; i < load_batch_size; i++) {
-      std::string key = BuildKeyName(key_generator.Next(), key_len);
-      std::string val = std::to_string(10);
-      trie->Put(0, version, key, val);
+      batch.emplace_back(BuildKeyName(key_generator.Next(), key_len),
+                         std::to_string(10));
     }
+    trie->PutBatch(0, version, std::move(batch));
     trie->Commit(version);
     auto end = chrono::system_clock::now();
     auto duration = chrono::duration_cast<chrono::microseconds>(end - start);
@@ -173,6 +175,8 @@ int main(int argc, char** argv) {
   int txn_key_id = 0;
   for (; version <= num_load_version + num_txn_version; version++) {
     auto start = chrono::system_clock::now();
+    std::vector<std::pair<std::string, std::string>> batch;
+    batch.reserve(2 * txn_batch_size);
     for (int i = 0; i < txn_batch_size; i++) {
       std::string key_send = BuildKeyName(random_keys[txn_key_id], key_len);
       txn_key_id++;
@@ -186,9 +190,10 @@ int main(int argc, char** argv) {
         value_send -= 1;
         value_recv += 1;
       }
-      trie->Put(0, version, key_send, std::to_string(value_send));
-      trie->Put(0, version, key_recv, std::to_string(value_recv));
+      batch.emplace_back(std::move(key_send), std::to_string(value_send));
+      batch.emplace_back(std::move(key_recv), std::to_string(value_recv));
     }
+    trie->PutBatch(0, version, std::move(batch));
 
     trie->Commit(version);
     auto end = chrono::system_clock::now();
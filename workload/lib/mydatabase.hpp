@@ -137,6 +137,9 @@ class MyDatabase {
 
     const size_t BATCH_SIZE = 1000;  // Batch size for efficient writing
     size_t current_batch_size = 0;
+    // keys of the current batch, borrowed by the trie until Commit
+    std::vector<std::string> keys(BATCH_SIZE);
+    std::vector<KeyValueRef> batch(BATCH_SIZE);
 
     // Process data in batches for better performance
     for (uint64_t i = 0; i < count; ++i) {
@@ -150,11 +153,13 @@ class MyDatabase {
         key = key.substr(0, static_cast<size_t>(key_len));
       }
 
-      trie->Put(0, version, key, fixed_value);
+      keys[current_batch_size] = std::move(key);
+      batch[current_batch_size] = {keys[current_batch_size], fixed_value};
       current_batch_size++;
 
       // Process batch when batch size is reached or at the end
       if (current_batch_size >= BATCH_SIZE || i == count - 1) {
+        trie->PutBatch(0, version, batch.data(), current_batch_size);
         trie->Commit(version);
         version++;
         current_batch_size = 0;
@@ -221,9 +226,7 @@ class MyDatabase {
 
   // Random read data (internal helper)
   void read_data(const std::vector<std::string>& keys) {
-    for (const auto& key : keys) {
-      trie->Get(0, version - 1, key);
-    }
+    trie->MultiGet(0, version - 1, keys);
   }
 
   // Write data with key:value pairs (internal helper)
@@ -234,9 +237,11 @@ class MyDatabase {
       std::cerr << "Error: keys and vectors size mismatch!" << std::endl;
       return;
     }
-    for (int i = 0; i < keys.size(); i++) {
-      trie->Put(0, version, keys[i], values[i]);
+    std::vector<KeyValueRef> batch(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      batch[i] = {keys[i], values[i]};
     }
+    trie->PutBatch(0, version, batch.data(), batch.size());
     trie->Commit(version);
   }
 